@@ -0,0 +1,277 @@
+#include "Calculator.hpp"
+#include "Compiler.hpp"
+#include "Expression.hpp"
+#include "Parser.hpp"
+#include "SharedCalculator.hpp"
+#include "TokenProcessor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every heap allocation in the process goes through here so a benchmark can report allocations/op
+namespace {
+    std::atomic<size_t> allocationCount{0};
+}
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+    // Keeps the compiler from discarding a result that is otherwise unused
+    template<typename T>
+    void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    // Discards processInput's output without formatting cost showing up as I/O
+    class NullBuffer : public std::streambuf {
+        protected:
+            int overflow(int c) override { return c; }
+            std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    };
+
+    struct Options {
+        double minTime = 0.2;    // seconds per repetition
+        int repetitions = 5;     // the median is reported
+        const char* filter = nullptr;
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::function<void()> body;  // one operation
+    };
+
+    void runBenchmark(const Benchmark& bench, const Options& options) {
+        using Clock = std::chrono::steady_clock;
+
+        // Grow the iteration count until one repetition takes at least minTime
+        size_t iterations = 1;
+        while (true) {
+            auto start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) bench.body();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            if (elapsed >= options.minTime || iterations >= (size_t(1) << 30)) break;
+            double scale = elapsed > 0 ? options.minTime * 1.2 / elapsed : 10.0;
+            iterations = static_cast<size_t>(iterations * std::clamp(scale, 1.5, 10.0));
+        }
+
+        std::vector<double> nsPerOp;
+        std::vector<double> allocsPerOp;
+        for (int rep = 0; rep < options.repetitions; ++rep) {
+            size_t allocsBefore = allocationCount.load(std::memory_order_relaxed);
+            auto start = Clock::now();
+            for (size_t i = 0; i < iterations; ++i) bench.body();
+            auto end = Clock::now();
+            size_t allocs = allocationCount.load(std::memory_order_relaxed) - allocsBefore;
+
+            nsPerOp.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+            allocsPerOp.push_back(static_cast<double>(allocs) / iterations);
+        }
+
+        std::sort(nsPerOp.begin(), nsPerOp.end());
+        std::sort(allocsPerOp.begin(), allocsPerOp.end());
+        std::printf("%-32s %12zu %14.1f %12.2f\n", bench.name.c_str(), iterations,
+                    nsPerOp[nsPerOp.size() / 2], allocsPerOp[allocsPerOp.size() / 2]);
+    }
+
+    // Inputs are generated deterministically so runs are comparable across versions
+    std::string longExpression(int terms) {
+        std::string expr;
+        for (int i = 0; i < terms; ++i) {
+            if (i > 0) expr += (i % 3 == 0) ? " + " : (i % 3 == 1) ? " * " : " - ";
+            expr += std::to_string(i % 97 + 1) + "." + std::to_string(i % 10);
+        }
+        return expr;
+    }
+
+    std::string nestedExpression(int depth) {
+        std::string expr;
+        for (int i = 0; i < depth; ++i) expr += "(" + std::to_string(i % 9 + 1) + " + ";
+        expr += "x";
+        for (int i = 0; i < depth; ++i) expr += ")";
+        return expr;
+    }
+
+    // Read throughput of a SharedCalculator with 1, 2, 4, ... reader threads while another
+    // thread publishes an upd five times a second
+    void runSharedReads(const Options& options) {
+        NullBuffer nullBuffer;
+        std::ostream nullOut(&nullBuffer);
+        calc::SharedCalculator shared;
+        shared.update("def mean 0", nullOut);
+        shared.update("create func normal_pdf(x, std): (1/(std*sqrt(2*pi)))*e^(-0.5*((x-mean)/std)^2)", nullOut);
+
+        size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        std::printf("\n%-32s %12s %14s %12s\n", "shared/normal_pdf", "threads", "calls/s", "per thread");
+        for (size_t threads = 1; threads <= cores; threads *= 2) {
+            std::atomic<bool> stop{false};
+            std::vector<size_t> calls(threads);
+            std::vector<std::thread> readers;
+            for (size_t t = 0; t < threads; ++t) {
+                readers.emplace_back([&shared, &stop, &count = calls[t]] {
+                    calc::SharedCalculator::Reader reader(shared);
+                    std::vector<double> args{0.5, 1.0};
+                    size_t n = 0;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        for (int i = 0; i < 256; ++i) doNotOptimize(reader.callFunction("normal_pdf", args));
+                        n += 256;
+                    }
+                    count = n;
+                });
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            double seconds = options.minTime * options.repetitions;
+            for (int update = 0; update < static_cast<int>(seconds * 5); ++update) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                shared.update("upd mean " + std::to_string(update % 2), nullOut);
+            }
+            stop = true;
+            for (auto& reader : readers) reader.join();
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            size_t total = 0;
+            for (size_t count : calls) total += count;
+            std::printf("%-32s %12zu %14.0f %12.0f\n", "", threads, total / elapsed, total / elapsed / threads);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            options.minTime = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            options.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::printf("Usage: calscript_bench [--filter substring] [--min-time seconds] [--repetitions n]\n");
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 2;
+        }
+    }
+
+    NullBuffer nullBuffer;
+    std::ostream nullOut(&nullBuffer);
+
+    calc::TokenProcessor tokenizer;
+    calc::Calculator calculator;
+    calculator.setOutput(nullOut);
+
+    const std::string shortExpr = "2 + 3 * 4";
+    const std::string longExpr = longExpression(200);
+    const std::string implicitExpr = "2pi(3+4)sin(30)4e(1+2)(3+4)2phi(5)(6)sqrt2 3!(2)";
+    const std::string nestedExpr = nestedExpression(64);
+
+    auto tokenize = [&](const std::string& expr) {
+        return [&tokenizer, &expr] {
+            calc::TokenProcessor::Scope scope(tokenizer);
+            doNotOptimize(tokenizer.tokenize(expr));
+        };
+    };
+
+    std::vector<double> pdfArgs{0.5, 0.0, 1.0};
+    std::vector<double> nestedArgs{1.5};
+    std::vector<double> pointArgs{3.0, 4.0};
+    std::vector<std::vector<double>> pdfColumns(3, std::vector<double>(4096));
+    for (size_t i = 0; i < 4096; ++i) {
+        pdfColumns[0][i] = (static_cast<double>(i) - 2048) / 512;
+        pdfColumns[1][i] = 0.0;
+        pdfColumns[2][i] = 1.0 + (i % 7) / 7.0;
+    }
+
+    // Definitions shared by the call and processInput benchmarks, with many globals
+    // so lookups are measured against a realistically sized variable table
+    for (int i = 0; i < 10000; ++i) {
+        calculator.defineVariable("g" + std::to_string(i), i * 0.5);
+    }
+    calculator.defineFunction("nested", {"x"}, nestedExpr);
+    calculator.defineFunction("normal_pdf", {"x", "mean", "std"},
+                              "(1/(std*sqrt(2*pi)))*e^(-0.5*((x-mean)/std)^2)");
+    calculator.defineFunction("use_globals", {"x"}, "g0 * x + g5000 - g9999 / x");
+    calculator.defineFunction("square", {"x"}, "x*x");
+    calculator.defineFunction("hypotenuse", {"a", "b"}, "sqrt(square(a) + square(b))");
+    calculator.defineFunction("distance", {"x", "y"}, "hypotenuse(x - 1, y + 2) + square(x)");
+
+    calc::Parser parser(calculator);
+    const calc::Expression pdfExpression = calc::Expression::compile(
+        "(1/(std*sqrt(2*pi)))*e^(-0.5*((x-mean)/std)^2)", {"x", "mean", "std"});
+
+    std::vector<Benchmark> benchmarks = {
+        {"tokenize/short", tokenize(shortExpr)},
+        {"tokenize/long_200_terms", tokenize(longExpr)},
+        {"tokenize/implicit_mul", tokenize(implicitExpr)},
+        {"compile/deep_nesting_64", [&] {
+            calc::Parser::Scope scope(parser);
+            doNotOptimize(calc::Compiler::compile(parser.parseExpression(nestedExpr), {"x"}));
+        }},
+        {"compile/long_200_terms", [&] {
+            calc::Parser::Scope scope(parser);
+            doNotOptimize(calc::Compiler::compile(parser.parseExpression(longExpr)));
+        }},
+        {"eval/deep_nesting_64", [&] {
+            doNotOptimize(calculator.callFunction("nested", nestedArgs));
+        }},
+        {"call/normal_pdf", [&] {
+            doNotOptimize(calculator.callFunction("normal_pdf", pdfArgs));
+        }},
+        {"call/many_globals_10000", [&] {
+            doNotOptimize(calculator.callFunction("use_globals", nestedArgs));
+        }},
+        {"call/nested_small_functions", [&] {
+            doNotOptimize(calculator.callFunction("distance", pointArgs));
+        }},
+        {"call/batch_normal_pdf_4096", [&] {
+            doNotOptimize(calculator.callFunctionBatch("normal_pdf", pdfColumns));
+        }},
+        {"expression/normal_pdf", [&] {
+            doNotOptimize(pdfExpression.eval(pdfArgs.data()));
+        }},
+        {"process/expression", [&] {
+            doNotOptimize(calculator.processInput("3 * (4 + 5) / 2 - sin(30)"));
+        }},
+        {"process/function_call", [&] {
+            doNotOptimize(calculator.processInput("normal_pdf(0.5, 0, 1)"));
+        }},
+        {"process/nested_call", [&] {
+            doNotOptimize(calculator.processInput("2 * normal_pdf(0.5, 0, 1) + nested(2)"));
+        }},
+        {"process/repeated_line", [&] {
+            doNotOptimize(calculator.processInput("g1 * normal_pdf(g2, 0, 1) + square(g3)"));
+        }},
+        {"process/update_variable", [&] {
+            doNotOptimize(calculator.processInput("upd g42 g41 * 2 + 1"));
+        }},
+    };
+
+    std::printf("%-32s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+    for (const auto& bench : benchmarks) {
+        if (options.filter && bench.name.find(options.filter) == std::string::npos) continue;
+        runBenchmark(bench, options);
+    }
+    if (!options.filter || std::string("shared/normal_pdf").find(options.filter) != std::string::npos) {
+        runSharedReads(options);
+    }
+    return 0;
+}
\ No newline at end of file
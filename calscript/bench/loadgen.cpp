@@ -0,0 +1,245 @@
+// Load generator for calscript --serve: opens a number of connections, keeps a fixed number
+// of lines in flight on each and reports throughput and latency percentiles.
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        const char* socketPath = nullptr;
+        int port = -1;
+        int connections = 4;
+        int pipeline = 16;         // lines in flight per connection
+        long requests = 100000;    // per connection
+        std::vector<std::string> setup;  // run once per connection before timing starts
+        std::string expression = "3 * (4 + 5) / 2 - sin({i})";
+    };
+
+    struct Result {
+        std::vector<double> latencies;  // microseconds, one per request
+        long errors = 0;
+        std::string failure;            // set if the connection broke
+    };
+
+    int connectTo(const Options& options) {
+        if (options.socketPath) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::strncpy(address.sun_path, options.socketPath, sizeof address.sun_path - 1);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0) return fd;
+            if (fd >= 0) ::close(fd);
+            return -1;
+        }
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0) {
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+            return fd;
+        }
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    // The expression with every {i} replaced by the request number, so lines differ
+    // (identical lines would be answered from the server's line cache)
+    std::string requestLine(const std::string& expression, long i) {
+        std::string line;
+        size_t start = 0;
+        size_t found;
+        while ((found = expression.find("{i}", start)) != std::string::npos) {
+            line.append(expression, start, found - start);
+            line += std::to_string(i);
+            start = found + 3;
+        }
+        line.append(expression, start, std::string::npos);
+        line += '\n';
+        return line;
+    }
+
+    bool sendAll(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t count = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0) return false;
+            sent += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    // Reads responses ("ok <n>" or "err <n>" followed by n lines) as they arrive
+    class ResponseReader {
+        public:
+            explicit ResponseReader(int fd) : fd_(fd) {}
+
+            // Blocks until at least one response is complete; returns how many, or -1 on failure
+            long readSome(long& errors) {
+                long complete = 0;
+                while (complete == 0) {
+                    char data[64 * 1024];
+                    ssize_t count = ::recv(fd_, data, sizeof data, 0);
+                    if (count <= 0) return -1;
+                    buffer_.append(data, static_cast<size_t>(count));
+                    complete = parse(errors);
+                    if (complete < 0) return -1;
+                }
+                return complete;
+            }
+
+        private:
+            int fd_;
+            std::string buffer_;
+
+            long parse(long& errors) {
+                long complete = 0;
+                size_t position = 0;
+                while (true) {
+                    size_t end = buffer_.find('\n', position);
+                    if (end == std::string::npos) break;
+                    bool ok = buffer_.compare(position, 3, "ok ") == 0;
+                    if (!ok && buffer_.compare(position, 4, "err ") != 0) return -1;
+                    long lines = std::atol(buffer_.c_str() + position + (ok ? 3 : 4));
+
+                    size_t next = end + 1;
+                    for (long i = 0; i < lines && next != std::string::npos; ++i) {
+                        size_t lineEnd = buffer_.find('\n', next);
+                        next = lineEnd == std::string::npos ? std::string::npos : lineEnd + 1;
+                    }
+                    if (next == std::string::npos) break;  // body not here yet
+
+                    if (!ok) errors++;
+                    complete++;
+                    position = next;
+                }
+                buffer_.erase(0, position);
+                return complete;
+            }
+    };
+
+    void runConnection(const Options& options, Result& result) {
+        int fd = connectTo(options);
+        if (fd < 0) {
+            result.failure = std::string("cannot connect: ") + std::strerror(errno);
+            return;
+        }
+
+        ResponseReader reader(fd);
+        long ignored = 0;
+        for (const auto& line : options.setup) {
+            if (!sendAll(fd, line + "\n") || reader.readSome(ignored) < 0) {
+                result.failure = "connection lost during setup";
+                ::close(fd);
+                return;
+            }
+        }
+
+        result.latencies.reserve(static_cast<size_t>(options.requests));
+        std::deque<Clock::time_point> inFlight;
+        long issued = 0;
+        std::string batch;
+        while (static_cast<long>(result.latencies.size()) < options.requests) {
+            // Top the pipeline up in one write
+            batch.clear();
+            auto now = Clock::now();
+            while (issued < options.requests && static_cast<int>(inFlight.size()) < options.pipeline) {
+                batch += requestLine(options.expression, issued++);
+                inFlight.push_back(now);
+            }
+            if (!batch.empty() && !sendAll(fd, batch)) break;
+
+            long complete = reader.readSome(result.errors);
+            if (complete < 0) break;
+            auto done = Clock::now();
+            for (long i = 0; i < complete && !inFlight.empty(); ++i) {
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(done - inFlight.front()).count());
+                inFlight.pop_front();
+            }
+        }
+        if (static_cast<long>(result.latencies.size()) < options.requests) result.failure = "connection lost";
+        ::close(fd);
+    }
+
+    void printUsage() {
+        std::printf("Usage: calscript_loadgen (--socket path | --port n) [--connections n] [--pipeline n]\n"
+                    "                         [--requests n] [--setup line]... [--expr expression]\n"
+                    "  --requests is per connection; {i} in the expression is replaced by the request number.\n");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--socket") == 0 && hasValue) {
+            options.socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--connections") == 0 && hasValue) {
+            options.connections = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--pipeline") == 0 && hasValue) {
+            options.pipeline = std::clamp(std::atoi(argv[++i]), 1, 4096);
+        } else if (std::strcmp(argv[i], "--requests") == 0 && hasValue) {
+            options.requests = std::max(1L, std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "--setup") == 0 && hasValue) {
+            options.setup.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--expr") == 0 && hasValue) {
+            options.expression = argv[++i];
+        } else {
+            printUsage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 2;
+        }
+    }
+    if ((options.socketPath == nullptr) == (options.port < 0)) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<Result> results(static_cast<size_t>(options.connections));
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (auto& result : results) {
+        threads.emplace_back([&options, &result] { runConnection(options, result); });
+    }
+    for (auto& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    long errors = 0;
+    for (const auto& result : results) {
+        if (!result.failure.empty()) {
+            std::fprintf(stderr, "calscript_loadgen: %s\n", result.failure.c_str());
+            return 1;
+        }
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    std::printf("%-14s %zu (%ld errors)\n", "requests", latencies.size(), errors);
+    std::printf("%-14s %.0f req/s\n", "throughput", latencies.size() / seconds);
+    std::printf("%-14s p50 %.1f us, p99 %.1f us, max %.1f us\n", "latency",
+                percentile(0.50), percentile(0.99), latencies.back());
+    return 0;
+}
\ No newline at end of file
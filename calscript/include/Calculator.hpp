@@ -1,12 +1,24 @@
 #pragma once
+#include <atomic>
 #include <unordered_map>
 #include <deque>
 #include <chrono>
 #include <functional>
+#include <list>
 #include <optional>
 #include <vector>
 #include "Token.hpp"
+#include "Program.hpp"
+#include "SymbolTable.hpp"
+#include "Parser.hpp"
+#include "MemoCache.hpp"
+#include "MemoryPool.hpp"
+#include "Constants.hpp"
+#include "CopyOnWrite.hpp"
+#include "Jit.hpp"
+#include "Profiler.hpp"
 #include <cmath>
+#include <ostream>
 
 namespace calc {
     class Calculator {
@@ -21,66 +33,227 @@ namespace calc {
             class Function {
                 public:
                     Function() = default;
-                    Function(std::string name, std::vector<std::string> params, std::vector<Token> body)
-                        : name_(std::move(name)), parameters_(std::move(params)), body_(std::move(body)) {}
+                    Function(std::string name, std::vector<std::string> params, std::string body, Program program)
+                        : name_(std::move(name)), parameters_(std::move(params)), body_(std::move(body)),
+                          baseProgram_(std::move(program)), program_(baseProgram_) {}
                     
                     const std::string& getName() const { return name_; }
                     const std::vector<std::string>& getParameters() const { return parameters_; }
-                    const std::vector<Token>& getBody() const { return body_; }
+                    const std::string& getBody() const { return body_; }
+                    const Program& getBaseProgram() const { return baseProgram_; }
+                    const Program& getProgram() const { return program_; }
+                    const std::vector<SymbolId>& getCallees() const { return callees_; }
+
+                    // Installs the body with small callees inlined into it
+                    void link(Program program, std::vector<SymbolId> callees) {
+                        program_ = std::move(program);
+                        callees_ = std::move(callees);
+                        tiering_ = Tiering();
+                    }
+
+                    // Counts a call; true for the one call that makes the body hot enough to compile
+                    // to native code. Counting stops there, so hot calls write nothing shared.
+                    bool countCall() const {
+                        if (tiering_.calls.load(std::memory_order_relaxed) >= Constants::JIT_THRESHOLD) return false;
+                        return tiering_.calls.fetch_add(1, std::memory_order_relaxed) + 1 == Constants::JIT_THRESHOLD;
+                    }
+                    void setNativeCode(std::shared_ptr<const JitCode> code) const {
+                        const JitCode* native = code.get();
+                        std::atomic_store(&tiering_.code, std::move(code));
+                        tiering_.native.store(native, std::memory_order_release);
+                    }
+                    const JitCode* getNativeCode() const { return tiering_.native.load(std::memory_order_acquire); }
                     
                 private:
+                    // Counted and compiled while calls run, so it changes through const, on whichever
+                    // thread is calling: calculators share functions (see CopyOnWrite)
+                    struct Tiering {
+                        std::atomic<uint64_t> calls{0};
+                        std::atomic<const JitCode*> native{nullptr};  // program_ as native code, once hot
+                        std::shared_ptr<const JitCode> code;  // owns native; read and written atomically
+
+                        Tiering() = default;
+                        Tiering(const Tiering& other) { *this = other; }
+                        Tiering& operator=(const Tiering& other) {
+                            code = std::atomic_load(&other.code);
+                            native.store(code.get(), std::memory_order_relaxed);
+                            calls.store(other.calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                            return *this;
+                        }
+                    };
+
                     std::string name_;
                     std::vector<std::string> parameters_;
-                    std::vector<Token> body_;
+                    std::string body_;  // source text
+                    Program baseProgram_;  // body compiled once at definition time, calls left as calls
+                    Program program_;  // what runs: baseProgram_ with small callees inlined
+                    std::vector<SymbolId> callees_;  // functions program_ was linked against
+                    mutable Tiering tiering_;
             };
         
-            using CommandHandler = std::function<void(const std::vector<std::string>&)>;
+            using CommandHandler = std::function<void(const std::vector<std::string_view>&)>;
 
             Calculator();
+            Calculator(const Calculator&) = delete;  // command handlers are bound to this instance
+            Calculator& operator=(const Calculator&) = delete;
 
-            void processInput(std::string_view input);
+            // Evaluates one line and writes its output; returns false if an error was reported.
+            // A non-zero lineNumber is included in error messages (used by batch mode).
+            bool processInput(std::string_view input, size_t lineNumber = 0);
+            // Output of processInput is discarded until a stream is set
+            void setOutput(std::ostream& out) { out_ = &out; }
+            // Value of an expression (no commands or definitions), without printing it or
+            // recording it in history; throws CalcError
+            double evaluate(std::string_view expression);
             void defineVariable(std::string_view name, double value);
             void deleteVariable(std::string_view name);
             void updateVariable(std::string_view name, double value);
-            const std::unordered_map<std::string, double>& getVariables() const { return variables_; }
+            std::unordered_map<std::string, double> getVariables() const;
             const std::deque<HistoryEntry>& getHistory() const { return history_; }
             void clearHistory();
             void deleteAllVariables();
             
             // Function management
-            void defineFunction(const std::string& name, const std::vector<std::string>& params, const std::vector<Token>& body);
+            void defineFunction(const std::string& name, const std::vector<std::string>& params, std::string_view body);
             void deleteFunction(const std::string& name);
             double callFunction(const std::string& name, const std::vector<double>& args);
+            // Evaluates name once per row, where columns[p] holds argument p for every row.
+            // Instructions run over blocks of rows at a time; results and errors match calling
+            // callFunction row by row.
+            std::vector<double> callFunctionBatch(const std::string& name, const std::vector<std::vector<double>>& columns);
             bool functionExists(const std::string& name) const;
+            bool functionExists(SymbolId id) const { return functions_->contains(id); }
+            const Function* getFunction(SymbolId id) const { return functions_->find(id); }
+
+            // Functions (as compiled), variables and formulas in a binary image, so a process can
+            // start with them without parsing and compiling every definition again
+            void saveImage(const std::string& path) const;
+            void loadImage(const std::string& path);
+            // Whether input lines may read and write files (save funcs, load funcs, prof dump).
+            // On by default; off for input from untrusted clients, such as server sessions.
+            void setFileAccess(bool enabled) { fileAccess_ = enabled; }
+            bool hasFileAccess() const { return fileAccess_; }
+
+            // Result caching for functions called repeatedly with the same arguments
+            void enableMemo(const std::string& name, size_t capacity = Constants::DEFAULT_MEMO_CAPACITY);
+            void disableMemo(const std::string& name);
+            bool isMemoized(SymbolId id) const { return memos_.contains(id); }
+
+            // Native code for function bodies called often (on by default where available)
+            void setJitEnabled(bool enabled);
+            bool isJitEnabled() const { return jitEnabled_; }
+
+            // Timing of each phase and user function call (prof on|off|dump). Enabling starts a
+            // new profile; throws CalcError in builds with CALSCRIPT_NO_PROFILE.
+            void setProfiling(bool enabled);
+            bool isProfiling() const { return profiler_.isEnabled(); }
+            const Profiler& getProfiler() const { return profiler_; }
+
+            // Formula variables hold an expression instead of a fixed value and are recomputed,
+            // in dependency order, whenever a variable or function they read changes
+            void defineFormula(const std::string& name, std::string_view expression);
+            bool isFormula(SymbolId id) const { return formulas_->contains(id); }
+
+            // Parallel batch support: a line is independent if it only evaluates an expression,
+            // so it gives the same result on any calculator holding the same variables and
+            // functions, unless it reads ans. Only the leading keyword is checked.
+            bool isIndependent(std::string_view input);
+            // Variables, functions and ans. The tables are shared rather than copied, so this
+            // takes constant time however much is defined; memo caches start empty.
+            void copyStateFrom(const Calculator& other);
+            void appendHistory(const HistoryEntry& entry);
+            double getLastResult() const { return lastResult_; }
+            void setLastResult(double value) { lastResult_ = value; lastResultKnown_ = true; }
+            // Leaves ans unknown until a line produces a result. Until then processInput skips a
+            // line that reads ans, printing and recording nothing, and skippedForAns() is true.
+            void forgetLastResult() { lastResultKnown_ = false; }
+            bool skippedForAns() const { return skippedForAns_; }
 
         private:
-            std::unordered_map<std::string, double> variables_;
+            // All names are interned; these are dense tables indexed by SymbolId. Variables,
+            // functions and formulas are shared with calculators copied from this one
+            // (copyStateFrom) until either side changes them.
+            CopyOnWrite<SymbolMap<double>> variables_;
             std::deque<HistoryEntry> history_;
-            std::unordered_map<std::string, CommandHandler> commands_;
-            std::unordered_map<std::string, Function> functions_;
+            SymbolMap<CommandHandler> commands_;
+            CopyOnWrite<SymbolMap<Function>> functions_;
+            SymbolMap<MemoCache> memos_;
+            struct Formula {
+                std::string expression;
+                Program program;
+                std::vector<SymbolId> inputs;  // variables and functions it reads, sorted
+            };
+            CopyOnWrite<SymbolMap<Formula>> formulas_;
+            CopyOnWrite<std::vector<std::vector<SymbolId>>> dependents_;  // by SymbolId: formulas that read it
+            uint64_t stateEpoch_{0};  // bumped whenever a variable or function changes; invalidates memos
+
+            // Expression lines seen before, keyed on their whitespace-normalized text. An entry
+            // is valid while the variables it reads keep their versions and no function changes.
+            // When full, the least recently used line is dropped, as in MemoCache.
+            struct CachedLine {
+                std::string key;
+                Program program;
+                std::vector<std::pair<SymbolId, uint64_t>> variables;
+                uint64_t functionEpoch;
+                std::optional<double> result;  // only when nothing it runs reads ans
+            };
+            std::list<CachedLine> lineCache_;  // most recently used first
+            std::unordered_map<std::string, std::list<CachedLine>::iterator> lineIndex_;
+            std::string lineKey_;  // reused buffer for normalizing input
+            std::vector<uint64_t> variableVersions_;  // by SymbolId
+            uint64_t functionEpoch_{0};
 
             double lastResult_{0.0};
+            bool lastResultKnown_{true};
+            bool skippedForAns_{false};  // by the last processInput
+            size_t callDepth_{0};
+            bool jitEnabled_{JitCode::isAvailable()};
+            bool fileAccess_{true};
+            std::ostream discard_{nullptr};  // no buffer, so everything written is dropped
+            std::ostream* out_{&discard_};
+            Profiler profiler_;
+            MemoryPool<double> batchStack_;  // executeBatch slots; nested calls stack up behind their caller's
+            Parser parser_{*this};  // per-calculator, so calculators can run on separate threads
 
             void setupCommands();
+            void requireFileAccess() const;
+            void touchVariable(SymbolId id);
+            bool runCachedLine(std::string_view input);
+            void cacheLine(Program program, double result);
+            void collectDependencies(const Program& program, std::vector<SymbolId>& variables,
+                                     std::vector<bool>& visited, bool& readsAns) const;
+            Formula compileFormula(SymbolId id, std::string_view expression);
+            void linkFormula(SymbolId id, Formula formula);
+            void unlinkFormula(SymbolId id);
+            void refreshFormulas(SymbolId changed);
+            void recomputeDependents(SymbolId changed);
+            void sortDependents(SymbolId id, std::vector<char>& state, std::vector<SymbolId>& order) const;
             void addToHistory(std::string_view input, std::optional<double> result = std::nullopt);
-            double evaluateExpression(const std::vector<Token>& tokens);
-            void handleCommand(std::string_view cmd, const std::vector<std::string>& args);
-            double evaluateMathFunction(const std::string& func, double arg);
-            bool isMathFunction(const std::string& op) const {
-                return op == "sin" || op == "cos" || op == "tan" || op == "log" ||
-                       op == "ln" || op == "sqrt";
-            }
-
-            void handleDefine(const std::string& varName, const std::string& valueExpr);
-            void handleDelete(const std::vector<std::string>& args);
-            void handleUpdate(const std::string& varName, const std::string& valueExpr);
-            void handleList(const std::vector<std::string>& args);
+            double evaluateExpression(const Expr& expr);
+            // Compiler::compile and execute at top level, timed as their phases
+            Program compile(const Expr& expr);
+            double run(const Program& program);
+            double execute(const Program& program, const double* frame);
+            void handleCommand(SymbolId cmd, const std::vector<std::string_view>& args);
+            std::optional<double> lookupValue(std::string_view name) const;
+
+            void handleDefine(std::string_view varName, std::string_view valueExpr);
+            void handleDelete(const std::vector<std::string_view>& args);
+            void handleUpdate(std::string_view varName, std::string_view valueExpr);
+            void handleList(const std::vector<std::string_view>& args);
             
             // Function handling
-            void handleFunctionDefinition(const std::vector<Token>& tokens);
-            void handleFunctionCall(const std::vector<Token>& tokens);
-            double evaluateWithLocalScope(const std::vector<Token>& body, 
-                                         const std::vector<std::string>& paramNames,
-                                         const std::vector<double>& paramValues);
+            double invokeFunction(SymbolId id, const Function& func, const double* args, size_t argc);
+            double runBody(const Function& func, const double* args);
+            static double jitLoadVariable(JitContext* context, uint32_t id);
+            static double jitCallFunction(JitContext* context, uint32_t id, const double* args, uint32_t argc);
+            void relinkCallers(SymbolId changed);
+            void relink(const std::vector<SymbolId>& ids);
+            static void checkArgumentCount(const Function& func, size_t argc);
+            // Batch counterpart of execute: frame[p] points at n values of parameter p. Returns false
+            // if some row hit a data-dependent error (the caller reruns those rows one at a time).
+            bool executeBatch(const Program& program, const double* const* frame, size_t n, double* out);
+            bool readsPreviousResult(SymbolId func, std::vector<bool>& visited) const;
+            bool readsPreviousResult(const Program& program, std::vector<bool>& visited) const;
     };
 }
\ No newline at end of file
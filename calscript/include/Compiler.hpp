@@ -0,0 +1,14 @@
+#pragma once
+#include "Parser.hpp"
+#include "Program.hpp"
+#include <string>
+#include <vector>
+
+namespace calc {
+    // Lowers a parsed expression into a postfix Program.
+    // Names listed in params are resolved to call frame slots instead of global variables.
+    class Compiler {
+        public:
+            static Program compile(const Expr& expr, const std::vector<std::string>& params = {});
+    };
+}
\ No newline at end of file
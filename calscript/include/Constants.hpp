@@ -1,5 +1,6 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <string>
 
@@ -10,6 +11,15 @@ namespace calc {
         static constexpr double PHI = 1.61803398874989484820;
         static constexpr double SQRT2 = 1.41421356237309504880;
         static constexpr size_t MAX_HISTORY = 100;
+        static constexpr size_t MAX_CALL_DEPTH = 1000;  // only reachable through a cycle of redefined functions
+        static constexpr size_t DEFAULT_MEMO_CAPACITY = 1024;
+        static constexpr size_t LINE_CACHE_CAPACITY = 4096;
+        static constexpr size_t BATCH_BLOCK = 256;  // rows evaluated together by callFunctionBatch
+        static constexpr size_t INLINE_STACK = 32;  // evaluation stack slots kept off the heap
+        static constexpr size_t MAX_NESTING = 1000;  // parentheses, prefix operators and ^ chains in one expression
+        static constexpr uint64_t JIT_THRESHOLD = 100;  // calls before a function body is compiled to native code
+        static constexpr size_t MAX_PROFILE_SPANS = 1 << 20;  // spans kept for the trace; totals keep counting
+        static constexpr int MAX_FACTORIAL = 170;  // largest n whose n! is finite as a double
         
         inline static const std::string PROMPT = "> ";
     };
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+namespace calc {
+    // A value shared by every copy until one of them changes it: copying takes a reference,
+    // and the first edit() after a copy gives the editor a private clone to change. A shared
+    // value is never changed in place, so copies on other threads can read it without locks.
+    // Only the owner edits; copies may be taken from several threads at once.
+    template<typename T>
+    class CopyOnWrite {
+        public:
+            CopyOnWrite() : value_(std::make_shared<T>()) {}
+
+            // Both sides are marked shared; the one that edits first clones
+            CopyOnWrite(const CopyOnWrite& other) : value_(other.value_), shared_(true) {
+                other.shared_.store(true, std::memory_order_relaxed);
+            }
+            CopyOnWrite& operator=(const CopyOnWrite& other) {
+                if (this != &other) {
+                    value_ = other.value_;
+                    shared_.store(true, std::memory_order_relaxed);
+                    other.shared_.store(true, std::memory_order_relaxed);
+                }
+                return *this;
+            }
+
+            const T& operator*() const { return *value_; }
+            const T* operator->() const { return value_.get(); }
+
+            T& edit() {
+                if (shared_.load(std::memory_order_relaxed)) {
+                    value_ = std::make_shared<T>(*value_);
+                    shared_.store(false, std::memory_order_relaxed);
+                }
+                return *value_;
+            }
+
+        private:
+            std::shared_ptr<T> value_;
+            // Set when a copy may hold value_; cleared by the clone. Atomic because copies
+            // can be taken concurrently (e.g. by ScriptRunner workers).
+            mutable std::atomic<bool> shared_{false};
+    };
+}
\ No newline at end of file
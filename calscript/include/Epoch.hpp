@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace calc {
+    // Epoch-based reclamation, for structures that readers use without locks while writers
+    // replace parts of them (read-copy-update). A reader marks itself active for the duration
+    // of a Guard; an object a writer has unlinked and retired is freed only once no reader
+    // that could still see it is active. Readers write nothing but their own slot, so reads
+    // scale with cores.
+    class EpochDomain {
+        private:
+            struct alignas(64) Slot {
+                std::atomic<uint64_t> epoch{0};  // epoch entered by the active reader, 0 when idle
+                std::atomic<bool> claimed{true};
+                Slot* next{nullptr};
+            };
+
+        public:
+            class Guard;
+
+            // A registration held by one thread at a time (usually one per thread); the slot is
+            // reused by a later reader once this one is destroyed
+            class Reader {
+                public:
+                    explicit Reader(EpochDomain& domain);
+                    ~Reader();
+
+                    Reader(const Reader&) = delete;
+                    Reader& operator=(const Reader&) = delete;
+
+                private:
+                    friend class Guard;
+                    EpochDomain& domain_;
+                    Slot* slot_;
+                    size_t depth_{0};  // nested guards
+            };
+
+            // Objects reachable from the shared structure while the guard lives stay allocated
+            class Guard {
+                public:
+                    explicit Guard(Reader& reader);
+                    ~Guard();
+
+                    Guard(const Guard&) = delete;
+                    Guard& operator=(const Guard&) = delete;
+
+                private:
+                    Reader& reader_;
+            };
+
+            EpochDomain() = default;
+            // Frees everything still retired; no reader may be active
+            ~EpochDomain();
+
+            EpochDomain(const EpochDomain&) = delete;
+            EpochDomain& operator=(const EpochDomain&) = delete;
+
+            // Call after unlinking an object from the shared structure: free runs once every
+            // reader active now has finished. Also frees earlier objects that have become safe.
+            void retire(std::function<void()> free);
+
+        private:
+            struct Retired {
+                uint64_t epoch;
+                std::function<void()> free;
+            };
+
+            std::atomic<Slot*> slots_{nullptr};  // only grows; slots are reused, never freed early
+            std::atomic<uint64_t> epoch_{1};
+            std::mutex retiredMutex_;
+            std::vector<Retired> retired_;
+
+            Slot* claim();
+    };
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include "Jit.hpp"
+#include "Program.hpp"
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace calc {
+    // An expression compiled once and evaluated many times, for programs that embed calscript.
+    // It stands alone: every name that is not a constant is a variable bound at each evaluation,
+    // and there are no user functions, globals or ans. Copies share the compiled code, and eval
+    // writes no shared state, so one expression can be evaluated on many threads at once.
+    class Expression {
+        public:
+            using Bindings = std::unordered_map<std::string, double>;
+
+            // Throws CalcError for invalid expressions. Variables are numbered in the order they
+            // first appear, unless listed up front in variables (which may include unused names).
+            static Expression compile(std::string_view source, const std::vector<std::string>& variables = {});
+
+            const std::string& getSource() const { return code_->source; }
+            const std::vector<std::string>& getVariables() const { return code_->variables; }
+            // Index of a variable in getVariables(), or -1 if the expression has none by that name
+            int slot(std::string_view name) const;
+
+            // values holds one value per variable, in getVariables() order. Errors (division by
+            // zero, sqrt(-1), ...) throw CalcError with the calculator's messages.
+            double eval(const double* values) const;
+            double eval(const std::vector<double>& values) const;  // these two also check the count
+            double eval(std::initializer_list<double> values) const;
+            double eval(const Bindings& bindings) const;  // throws if a variable is unbound
+
+        private:
+            struct Code {
+                std::string source;
+                std::vector<std::string> variables;
+                Program program;
+                std::shared_ptr<const JitCode> native;  // null where the JIT is unavailable
+            };
+
+            explicit Expression(std::shared_ptr<const Code> code) : code_(std::move(code)) {}
+
+            static double interpret(const Program& program, const double* values);
+            void checkCount(size_t count) const;
+
+            std::shared_ptr<const Code> code_;
+    };
+}
\ No newline at end of file
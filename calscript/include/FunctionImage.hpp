@@ -0,0 +1,125 @@
+#pragma once
+#include "MappedFile.hpp"
+#include "Program.hpp"
+#include "SymbolTable.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace calc {
+    // Binary image of compiled functions and variables, written by "save funcs" and read by
+    // "load funcs". Integers are in host byte order and every section starts 8-byte aligned:
+    //
+    //   Header
+    //   symbols    TextRef[symbolCount]          every name the image refers to
+    //   functions  FunctionEntry[functionCount]
+    //   params     uint32_t[paramCount]          symbol indexes, sliced by FunctionEntry
+    //   variables  VariableEntry[variableCount]
+    //   formulas   FormulaEntry[formulaCount]    each also listed (with its value) as a variable
+    //   code       Instruction[instructionCount] LoadVar and Call operands are symbol indexes
+    //   text       char[textSize]                names, bodies and formula expressions
+    //
+    // Programs are stored optimized but not inlined. Symbol ids differ between processes, so
+    // names are resolved when the image is read. Bump VERSION whenever any of these layouts,
+    // Instruction or the OpCode numbering changes.
+    namespace image {
+        constexpr char MAGIC[8] = {'C', 'A', 'L', 'S', 'I', 'M', 'G', '\0'};
+        constexpr uint32_t VERSION = 1;
+        constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t byteOrder;
+            uint32_t instructionSize;
+            uint32_t symbolCount;
+            uint32_t functionCount;
+            uint32_t paramCount;
+            uint32_t variableCount;
+            uint32_t formulaCount;
+            uint32_t instructionCount;
+            uint32_t textSize;
+        };
+
+        struct TextRef {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        struct FunctionEntry {
+            uint32_t name;
+            uint32_t firstParam;
+            uint32_t paramCount;
+            uint32_t firstInstruction;
+            uint32_t instructionCount;
+            uint32_t maxDepth;
+            uint32_t localCount;
+            TextRef body;
+            uint32_t reserved;
+        };
+
+        struct VariableEntry {
+            uint32_t name;
+            uint32_t reserved;
+            double value;
+        };
+
+        struct FormulaEntry {
+            uint32_t name;
+            TextRef expression;
+        };
+    }
+
+    // Collects functions and variables and writes them out as an image
+    class FunctionImageWriter {
+        public:
+            void addFunction(SymbolId name, const std::vector<std::string>& params, std::string_view body,
+                             const Program& program);
+            void addVariable(SymbolId name, double value);
+            void addFormula(SymbolId name, std::string_view expression);
+
+            void write(const std::string& path) const;  // throws CalcError if the file cannot be written
+
+        private:
+            std::vector<image::TextRef> symbols_;
+            std::unordered_map<SymbolId, uint32_t> symbolIndex_;
+            std::vector<image::FunctionEntry> functions_;
+            std::vector<uint32_t> params_;
+            std::vector<image::VariableEntry> variables_;
+            std::vector<image::FormulaEntry> formulas_;
+            std::vector<Instruction> code_;
+            std::string text_;
+
+            uint32_t symbol(SymbolId id);
+            image::TextRef text(std::string_view s);
+    };
+
+    // An image mapped into memory and decoded. Every offset, index and program is checked,
+    // including the stack depth each program needs, so a damaged file is rejected with a
+    // CalcError instead of being run. Text views point into the mapping and live as long as
+    // this object.
+    class FunctionImage {
+        public:
+            struct Function {
+                SymbolId name;
+                std::vector<SymbolId> params;
+                std::string_view body;
+                Program program;
+            };
+
+            explicit FunctionImage(const std::string& path);
+
+            const std::vector<Function>& getFunctions() const { return functions_; }
+            const std::vector<std::pair<SymbolId, double>>& getVariables() const { return variables_; }
+            const std::vector<std::pair<SymbolId, std::string_view>>& getFormulas() const { return formulas_; }
+
+        private:
+            MappedFile file_;
+            std::vector<Function> functions_;
+            std::vector<std::pair<SymbolId, double>> variables_;
+            std::vector<std::pair<SymbolId, std::string_view>> formulas_;
+    };
+}
\ No newline at end of file
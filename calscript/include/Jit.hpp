@@ -0,0 +1,47 @@
+#pragma once
+#include "Program.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+namespace calc {
+    // State shared by generated code and the calculator for one call. Generated code reads
+    // the fields before error by offset, so they must stay standard layout.
+    struct JitContext {
+        double ans;
+        uint8_t failed;  // set to abandon the call: error holds the exception, or the call is rerun by the interpreter
+        void* calculator;
+        double (*loadVariable)(JitContext* context, uint32_t id);
+        double (*callFunction)(JitContext* context, uint32_t id, const double* args, uint32_t argc);
+        std::exception_ptr error;
+    };
+
+    // Native x86-64 code for one function body (System V calling convention, SSE2 only).
+    // The value stack lives in xmm registers; math functions, pow and user function calls go
+    // through helpers. Anything that would report an error at run time (division by zero,
+    // sqrt(-1), tan(90), ...) abandons the call instead, so the interpreter can rerun it and
+    // report the error exactly as it always has. The code does not depend on any one
+    // calculator, so calculators copying a function can share it.
+    class JitCode {
+        public:
+            // Returns nullptr when the program cannot be compiled (or the JIT is not built in)
+            static std::shared_ptr<const JitCode> compile(const Program& program);
+            static bool isAvailable();
+
+            ~JitCode();
+            JitCode(const JitCode&) = delete;
+            JitCode& operator=(const JitCode&) = delete;
+
+            double run(const double* frame, JitContext& context) const { return entry_(frame, &context); }
+
+        private:
+            using Entry = double (*)(const double* frame, JitContext* context);
+
+            JitCode(void* memory, size_t size);
+
+            void* memory_;
+            size_t size_;
+            Entry entry_;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+namespace calc {
+    // Read-only view of a whole file. Uses mmap where available so large scripts are
+    // read straight from the page cache; falls back to reading the file into memory.
+    class MappedFile {
+        public:
+            explicit MappedFile(const std::string& path);  // throws CalcError if the file cannot be read
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            std::string_view getContents() const { return {data_, size_}; }
+
+        private:
+            const char* data_{nullptr};
+            size_t size_{0};
+            bool mapped_{false};
+            std::string buffer_;  // only used by the fallback path
+    };
+}
\ No newline at end of file
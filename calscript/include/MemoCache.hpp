@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace calc {
+    // Bounded LRU cache of function results, keyed on the exact bit patterns of the
+    // arguments (so -0 and 0, or different NaNs, are different keys). Entries are only
+    // valid for one state epoch: a lookup under a newer epoch empties the cache first.
+    class MemoCache {
+        public:
+            using Key = std::vector<uint64_t>;
+
+            explicit MemoCache(size_t capacity) : capacity_(capacity) {}
+
+            // Copies keep the settings but start empty (index_ points into entries_)
+            MemoCache(const MemoCache& other)
+                : capacity_(other.capacity_), readsAns_(other.readsAns_) {}
+            MemoCache& operator=(const MemoCache& other) {
+                if (this != &other) *this = MemoCache(other);
+                return *this;
+            }
+            MemoCache(MemoCache&&) = default;
+            MemoCache& operator=(MemoCache&&) = default;
+
+            static Key makeKey(const double* args, size_t argc);
+
+            std::optional<double> find(const Key& key, uint64_t epoch);
+            void insert(Key key, double value, uint64_t epoch);
+
+            // Functions that read ans have it appended to their keys
+            bool readsAns() const { return readsAns_; }
+            void setReadsAns(bool readsAns) { readsAns_ = readsAns; }
+
+            size_t getCapacity() const { return capacity_; }
+            size_t size() const { return index_.size(); }
+            size_t getHits() const { return hits_; }
+            size_t getMisses() const { return misses_; }
+
+        private:
+            struct KeyHash {
+                size_t operator()(const Key& key) const;
+            };
+            struct Entry {
+                Key key;
+                double value;
+            };
+
+            size_t capacity_;
+            bool readsAns_{false};
+            uint64_t epoch_{0};
+            std::list<Entry> entries_;  // most recently used first
+            std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+            size_t hits_{0};
+            size_t misses_{0};
+
+            void sync(uint64_t epoch);
+    };
+}
\ No newline at end of file
@@ -1,60 +1,112 @@
 #pragma once
-#include <vector>
 #include <memory>
 #include <cstddef>
-#include <array>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace calc {
+    // Arena for trivially destructible objects. Memory is carved out of large blocks and
+    // released all at once by reset(); blocks are kept for reuse, so a steady workload
+    // stops allocating once the arena has grown to its working size.
     template<typename T, size_t BlockSize = 4096>
     class MemoryPool {
+        static_assert(std::is_trivially_destructible_v<T>, "MemoryPool never runs destructors");
+
     private:
         struct Block {
-            std::array<std::byte, BlockSize> data;
+            std::unique_ptr<std::byte[]> data;
+            size_t capacity;
             size_t used = 0;
             std::unique_ptr<Block> next = nullptr;
+
+            explicit Block(size_t size) : data(new std::byte[size]), capacity(size) {}
         };
 
         std::unique_ptr<Block> head_;
         Block* current_;
+        size_t blockCount_{1};
 
-    public:
-        MemoryPool() : head_(std::make_unique<Block>()), current_(head_.get()) {}
-
-        template<typename... Args>
-        T* allocate(Args&&... args) {
-            constexpr size_t size = sizeof(T);
+        void* allocateBytes(size_t size) {
             constexpr size_t alignment = alignof(T);
 
-            // Align the current position
-            size_t adjustment = (alignment - (current_->used % alignment)) % alignment;
-            size_t newUsed = current_->used + adjustment + size;
+            while (true) {
+                // Align the current position
+                size_t adjustment = (alignment - (current_->used % alignment)) % alignment;
+                size_t newUsed = current_->used + adjustment + size;
+
+                if (newUsed <= current_->capacity) {
+                    void* addr = &current_->data[current_->used + adjustment];
+                    current_->used = newUsed;
+                    return addr;
+                }
 
-            if (newUsed > BlockSize) {
-                // Create new block if current is full
-                if (!current_->next) {
-                    current_->next = std::make_unique<Block>();
+                // Move to the next block, inserting a new one if it is missing or too small
+                if (!current_->next || current_->next->capacity < size) {
+                    auto block = std::make_unique<Block>(std::max(BlockSize, size));
+                    block->next = std::move(current_->next);
+                    current_->next = std::move(block);
+                    blockCount_++;
                 }
                 current_ = current_->next.get();
                 current_->used = 0;
-                adjustment = (alignment - (current_->used % alignment)) % alignment;
-                newUsed = adjustment + size;
             }
+        }
 
-            // Get properly aligned address
-            void* addr = &current_->data[current_->used + adjustment];
-            current_->used = newUsed;
+    public:
+        // Allocation position; rewinding to it releases everything allocated since
+        struct Marker {
+            Block* block;
+            size_t used;
+        };
 
+        MemoryPool() : head_(std::make_unique<Block>(BlockSize)), current_(head_.get()) {}
+
+        MemoryPool(const MemoryPool&) = delete;
+        MemoryPool& operator=(const MemoryPool&) = delete;
+
+        template<typename... Args>
+        T* allocate(Args&&... args) {
             // Construct object in-place
-            return new (addr) T(std::forward<Args>(args)...);
+            return new (allocateBytes(sizeof(T))) T(std::forward<Args>(args)...);
+        }
+
+        // Uninitialized storage for count contiguous objects
+        T* allocateArray(size_t count) {
+            return static_cast<T*>(allocateBytes(sizeof(T) * std::max<size_t>(count, 1)));
         }
 
+        // Invalidates everything allocated so far
         void reset() {
-            current_ = head_.get();
-            while (current_) {
-                current_->used = 0;
-                current_ = current_->next.get();
+            for (Block* block = head_.get(); block; block = block->next.get()) {
+                block->used = 0;
             }
             current_ = head_.get();
         }
+
+        Marker mark() const { return {current_, current_->used}; }
+
+        // Invalidates everything allocated after marker was taken
+        void rewind(const Marker& marker) {
+            current_ = marker.block;
+            current_->used = marker.used;
+        }
+
+        // Releases everything allocated while it was alive
+        class Scope {
+        public:
+            explicit Scope(MemoryPool& pool) : pool_(pool), marker_(pool.mark()) {}
+            ~Scope() { pool_.rewind(marker_); }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            MemoryPool& pool_;
+            Marker marker_;
+        };
+
+        size_t getBlockCount() const { return blockCount_; }
     };
 }
\ No newline at end of file
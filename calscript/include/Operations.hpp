@@ -0,0 +1,68 @@
+#pragma once
+#include "Program.hpp"
+#include "Token.hpp"
+#include <cmath>
+
+namespace calc {
+    // What the arithmetic instructions compute, shared by everything that evaluates them:
+    // Calculator::execute and executeBatch, Expression, constant folding and native code.
+    // Operations throw CalcError outside their domain; isDefined tells callers that must not
+    // throw whether they would.
+    class Operations {
+        public:
+            static double divide(double a, double b) {
+                if (b == 0) throw CalcError("Division by zero");
+                return a / b;
+            }
+
+            static double modulo(double a, double b) {
+                if (b == 0) throw CalcError("Modulo by zero");
+                if (std::floor(a) != a || std::floor(b) != b) throw CalcError("Modulo requires integer operands");
+                return std::fmod(a, b);
+            }
+
+            static double factorial(double a);
+
+            // sqrt for positive x, pow itself for -0, -inf and negatives (NaN, not an error)
+            static double powHalf(double x) {
+                return (x > 0 || std::isnan(x)) ? std::sqrt(x) : std::pow(x, 0.5);
+            }
+
+            // Degree-based trig, logs and sqrt (Sin, Cos, Tan, Log, Ln and Sqrt)
+            static double mathFunction(OpCode op, double a);
+
+            // Whether apply(op, a, b) returns a value; false for instructions that are not
+            // arithmetic. Cheap enough to call per element when op is a constant.
+            static bool isDefined(OpCode op, double a, double b = 0) {
+                switch (op) {
+                    case OpCode::Add:
+                    case OpCode::Sub:
+                    case OpCode::Mul:
+                    case OpCode::Pow:
+                    case OpCode::Neg:
+                    case OpCode::Square:
+                    case OpCode::PowHalf:
+                    case OpCode::Sin:
+                    case OpCode::Cos:
+                    case OpCode::Log:
+                    case OpCode::Ln:
+                        return true;
+                    case OpCode::Div:
+                        return b != 0;
+                    case OpCode::Mod:
+                        return b != 0 && std::floor(a) == a && std::floor(b) == b;
+                    case OpCode::Factorial:
+                        return a >= 0 && std::floor(a) == a;
+                    case OpCode::Tan:
+                        return std::fmod(std::abs(a), 180) != 90;
+                    case OpCode::Sqrt:
+                        return !(a < 0);
+                    default:
+                        return false;
+                }
+            }
+
+            // Binary instructions take a and b, unary ones only a
+            static double apply(OpCode op, double a, double b = 0);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+#include "Program.hpp"
+#include "SymbolTable.hpp"
+#include <vector>
+
+namespace calc {
+    class Calculator;
+
+    // Rewrites a compiled program into a cheaper one: constant subexpressions are folded,
+    // x^2 and x^0.5 are strength-reduced and identity operations are dropped.
+    // Results are bit-for-bit the same as the original's, except that x^0.5 uses the
+    // correctly rounded sqrt where pow may be one ulp off. Anything that would report
+    // an error at run time (division by zero, sqrt(-1), ...) is left in place.
+    class Optimizer {
+        public:
+            static Program optimize(const Program& program);
+
+            // Replaces calls to small user functions with their bodies. Arguments are still
+            // evaluated first and in order (into local slots), so results and errors are those
+            // of the call. callees receives every function the program calls, inlined or not.
+            static Program inlineCalls(const Program& program, const Calculator& calculator,
+                                       std::vector<SymbolId>& callees);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+#include "Token.hpp"
+#include "TokenProcessor.hpp"
+#include "MemoryPool.hpp"
+#include "Profiler.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace calc {
+    class Calculator;
+
+    // Expression tree node. Nodes live in the Parser's arena until its enclosing Scope ends.
+    struct Expr {
+        enum class Kind : uint8_t {
+            Number,    // literal, constant or boolean
+            Variable,  // global variable or function parameter
+            Ans,       // previous result
+            Unary,     // op applied to lhs: negation, factorial or a math function
+            Binary,    // lhs op rhs
+            Call       // user function applied to argc arguments, chained from lhs through next
+        };
+
+        Kind kind = Kind::Number;
+        Operator op = Operator::None;
+        uint16_t argc = 0;
+        SymbolId symbol = NO_SYMBOL;  // Variable and Call
+        double value = 0.0;           // Number
+        std::string_view name;        // interned spelling of Variable and Call (the text, for unknown names)
+        const Expr* lhs = nullptr;
+        const Expr* rhs = nullptr;
+        const Expr* next = nullptr;   // following argument of a call
+    };
+
+    // One input line, classified by its leading keyword. Names and text are slices of the line;
+    // expression text is parsed by parseExpression when the statement runs, so errors in it are
+    // reported after errors in the names.
+    struct Statement {
+        enum class Kind : uint8_t {
+            Empty,           // blank line
+            Expression,      // text
+            Define,          // def name text
+            Update,          // upd name text
+            Formula,         // formula name text
+            CreateFunction,  // create func name(words...): text
+            UseFunction,     // use func text, where text starts with the function name
+            Command,         // command words...
+            DebugFunctions   // debug funcs
+        };
+
+        Kind kind = Kind::Empty;
+        SymbolId command = NO_SYMBOL;
+        std::string_view name;
+        std::vector<std::string_view> words;
+        std::string_view text;
+    };
+
+    // Front end for input lines: statements are split on their keywords in one pass over the
+    // line, and expressions are parsed by recursive descent from the tokenizer's output.
+    // The calculator is consulted to tell user function calls apart from implicit multiplication;
+    // without one there are no user functions, so name(...) multiplies.
+    class Parser {
+        public:
+            Parser() = default;
+            explicit Parser(const Calculator& calculator) : calculator_(&calculator) {}
+            Parser(const Parser&) = delete;
+            Parser& operator=(const Parser&) = delete;
+
+            Statement parseStatement(std::string_view line);
+            // Names as in TokenProcessor::tokenize: evaluation looks them up, so with a calculator
+            // a word that is not a name anywhere is reported as an undefined variable while
+            // parsing. Without one it is a Variable without a symbol.
+            const Expr& parseExpression(std::string_view text, TokenProcessor::Names names = TokenProcessor::Names::LookUp);
+            const Expr& parseExpression(const TokenList& tokens);
+
+            TokenProcessor& getTokenizer() { return tokenizer_; }
+            // Statement, tokenize and parse phases are timed on this profiler
+            void setProfiler(Profiler* profiler) { profiler_ = profiler; }
+
+            // Releases the tokens and trees produced while it was alive
+            class Scope {
+                public:
+                    explicit Scope(Parser& parser)
+                        : tokens_(parser.tokenizer_), pool_(parser.pool_), marker_(pool_.mark()) {}
+                    ~Scope() { pool_.rewind(marker_); }
+
+                    Scope(const Scope&) = delete;
+                    Scope& operator=(const Scope&) = delete;
+
+                private:
+                    TokenProcessor::Scope tokens_;
+                    MemoryPool<Expr>& pool_;
+                    MemoryPool<Expr>::Marker marker_;
+            };
+
+        private:
+            const Calculator* calculator_{nullptr};
+            Profiler* profiler_{nullptr};
+            TokenProcessor tokenizer_;
+            MemoryPool<Expr> pool_;
+            std::string lowered_;  // scratch for case-folding keywords
+    };
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+#include "Constants.hpp"
+#include "SymbolTable.hpp"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Times the rest of the enclosing block as a phase or a user function call. Compiles to
+// nothing with CALSCRIPT_NO_PROFILE; otherwise costs one branch while profiling is off.
+#ifdef CALSCRIPT_NO_PROFILE
+    #define CALSCRIPT_PROFILE(profiler, what)
+#else
+    #define CALSCRIPT_PROFILE(profiler, what) ::calc::Profiler::Scope profileScope((profiler), (what))
+#endif
+
+namespace calc {
+    // Per-calculator record of where evaluation spends its time (prof on|off|dump): a span for
+    // every phase and user function call while enabled, and totals per phase and per function
+    // with inclusive time and exclusive time (less the spans nested inside).
+    class Profiler {
+        public:
+            enum class Phase : uint8_t {
+                Line,       // processInput, start to finish
+                Statement,  // splitting a line on its keyword
+                Tokenize,
+                Parse,      // expression trees from tokens
+                Compile,    // bytecode; for function definitions also optimizing and relinking callers
+                Execute,    // expressions at top level; function bodies are recorded as calls
+                Count
+            };
+
+            // Starts a new profile, discarding the previous one
+            void start();
+            void stop() { enabled_ = false; }
+            bool isEnabled() const { return enabled_; }
+
+            class Scope {
+                public:
+                    Scope(Profiler* profiler, Phase phase)
+                        : profiler_(profiler && profiler->enabled_ ? profiler : nullptr) {
+                        if (profiler_) profiler_->begin(static_cast<uint32_t>(phase));
+                    }
+                    Scope(Profiler* profiler, SymbolId function)
+                        : profiler_(profiler && profiler->enabled_ ? profiler : nullptr) {
+                        if (profiler_) profiler_->begin(PHASE_COUNT + function);
+                    }
+                    // Spans begun while enabled end even if profiling stopped in between
+                    ~Scope() {
+                        if (profiler_) profiler_->end();
+                    }
+
+                    Scope(const Scope&) = delete;
+                    Scope& operator=(const Scope&) = delete;
+
+                private:
+                    Profiler* profiler_;
+            };
+
+            // Chrome trace event JSON (chrome://tracing, Perfetto), one complete event per span
+            void writeTrace(std::ostream& out) const;
+            // Phases, then functions by exclusive time
+            void writeTable(std::ostream& out) const;
+
+            size_t getSpanCount() const { return spans_.size(); }
+
+        private:
+            using Clock = std::chrono::steady_clock;
+            static constexpr uint32_t PHASE_COUNT = static_cast<uint32_t>(Phase::Count);
+
+            // Spans and totals are keyed by phase, or PHASE_COUNT + SymbolId for functions
+            struct Span {
+                uint32_t key;
+                int64_t start;     // nanoseconds since start()
+                int64_t duration;
+            };
+            struct Open {
+                uint32_t key;
+                Clock::time_point start;
+                int64_t children;  // nanoseconds spent in nested spans
+            };
+            struct Totals {
+                uint64_t count = 0;
+                int64_t inclusive = 0;
+                int64_t exclusive = 0;
+            };
+
+            bool enabled_{false};
+            Clock::time_point origin_;
+            std::vector<Open> open_;
+            std::vector<Span> spans_;   // at most MAX_PROFILE_SPANS, after which only totals grow
+            uint64_t dropped_{0};
+            std::vector<Totals> totals_;  // by key
+
+            void begin(uint32_t key);
+            void end();
+            static std::string keyName(uint32_t key);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include "SymbolTable.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace calc {
+    // Opcodes of the postfix instruction stream produced by the Compiler
+    enum class OpCode : uint8_t {
+        PushConst,     // push value
+        LoadVar,       // push variable with symbol id operand
+        LoadParam,     // push slot operand of the current call frame
+        LoadAns,       // push the previous result
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+        Pow,
+        Neg,
+        Factorial,
+        Sin,
+        Cos,
+        Tan,
+        Log,
+        Ln,
+        Sqrt,
+        Square,        // x*x, from x^2
+        PowHalf,       // x^0.5 without sqrt's domain error
+        StoreLocal,    // pop into local slot operand (arguments of an inlined call)
+        LoadLocal,     // push local slot operand
+        Call           // call function with symbol id operand with argc arguments
+    };
+
+    struct Instruction {
+        OpCode op;
+        uint16_t argc = 0;
+        uint32_t operand = 0;
+        double value = 0.0;
+    };
+
+    // A compiled expression
+    class Program {
+        public:
+            Program() = default;
+
+            const std::vector<Instruction>& getCode() const { return code_; }
+            size_t getMaxDepth() const { return maxDepth_; }
+            size_t getLocalCount() const { return localCount_; }
+            bool empty() const { return code_.empty(); }
+
+            void emit(OpCode op, double value = 0.0) { code_.push_back({op, 0, 0, value}); }
+            void emitSlot(OpCode op, uint32_t slot) { code_.push_back({op, 0, slot, 0.0}); }
+            void emitSymbol(OpCode op, SymbolId symbol, uint16_t argc = 0) {
+                code_.push_back({op, argc, symbol, 0.0});
+            }
+            void append(const Instruction& ins) { code_.push_back(ins); }
+            void setMaxDepth(size_t depth) { maxDepth_ = depth; }
+            void setLocalCount(size_t count) { localCount_ = count; }
+
+        private:
+            std::vector<Instruction> code_;
+            size_t maxDepth_{0};
+            size_t localCount_{0};
+    };
+}
\ No newline at end of file
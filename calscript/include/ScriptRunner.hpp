@@ -0,0 +1,41 @@
+#pragma once
+#include "Calculator.hpp"
+#include "ThreadPool.hpp"
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace calc {
+    // Non-interactive execution of scripts: no prompts, buffered output,
+    // errors reported with the line number they occurred on.
+    // With more than one job, runs of independent expression lines are evaluated in
+    // parallel on worker calculators; output and history still follow script order.
+    class ScriptRunner {
+        public:
+            struct Summary {
+                size_t lines = 0;
+                size_t errors = 0;
+            };
+
+            ScriptRunner(Calculator& calculator, std::ostream& out, size_t jobs = 1);
+
+            Summary run(std::istream& in);
+            // Runs a script held in memory (e.g. a MappedFile) without copying its lines
+            Summary run(std::string_view script);
+
+        private:
+            Calculator& calculator_;
+            std::ostream& out_;
+            Summary summary_;
+
+            std::unique_ptr<ThreadPool> pool_;  // only created for jobs > 1
+            std::vector<std::unique_ptr<Calculator>> workers_;  // one per pool thread
+
+            // Returns false when the script asked to stop (exit)
+            bool runLine(std::string_view line);
+            void runParallel(std::string_view script);
+            void runIndependent(const std::vector<std::string_view>& lines, size_t first, size_t last);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#include "Calculator.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace calc {
+    // Serves calculator sessions on a Unix domain socket and, optionally, on a loopback TCP port
+    // (--serve). Every connection gets its own Calculator, starting from a copy of the prototype's
+    // variables and functions, and sends input lines exactly as typed at the prompt. Each line is
+    // answered, in order, with a header and the lines the calculator printed:
+    //
+    //   ok <n>     the line succeeded and printed n lines (e.g. "ok 1" then "= 42")
+    //   err <n>    the line reported an error; the n lines include the message
+    //
+    // so clients can pipeline any number of lines without waiting. "exit" closes the session.
+    // Commands that read or write files (save funcs, load funcs, prof dump) answer with an error.
+    // One thread runs every connection from a non-blocking epoll loop (Linux only).
+    class Server {
+        public:
+            struct Options {
+                std::string socketPath;  // created (replacing a stale socket) and removed again on exit
+                int port = -1;           // also listen on 127.0.0.1:port when >= 0; 0 picks a free port
+            };
+
+            // Opens the listening sockets; throws CalcError if they cannot be set up
+            Server(const Calculator& prototype, Options options);
+            ~Server();
+
+            Server(const Server&) = delete;
+            Server& operator=(const Server&) = delete;
+
+            int getPort() const { return port_; }
+
+            // Serves connections until stop() is called, then closes them
+            void run();
+            // Safe to call from signal handlers and other threads
+            void stop();
+
+        private:
+            struct Connection;
+
+            const Calculator& prototype_;
+            Options options_;
+            int epoll_{-1};
+            int wake_{-1};  // eventfd written by stop()
+            int unixListener_{-1};
+            int tcpListener_{-1};
+            int port_{-1};
+            std::vector<std::unique_ptr<Connection>> connections_;  // indexed by file descriptor
+
+            void release();  // closes every socket and removes the socket file
+            void listenUnix();
+            void listenTcp();
+            void watch(int fd, uint32_t events);
+            void accept(int listener);
+            void receive(Connection& connection);
+            void runLines(Connection& connection);
+            void runLine(Connection& connection, std::string_view line);
+            void send(Connection& connection);
+            void update(Connection& connection);
+            void close(int fd);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include "Calculator.hpp"
+#include "Epoch.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace calc {
+    // Variables and functions shared by many evaluating threads. Lines that change them (upd,
+    // create func, load funcs, ...) run through update(), which publishes the result as a new
+    // immutable version; each thread evaluates through its own Reader, against the version
+    // that was current when the call started. Readers take no locks and are never blocked by
+    // updates; versions no reader can still be using are reclaimed through epochs.
+    // A version holds the writer's tables by reference (see CopyOnWrite): publishing copies
+    // nothing, and the writer clones a table only when its next update changes it.
+    class SharedCalculator {
+        public:
+            SharedCalculator();
+            // Every Reader must be destroyed first
+            ~SharedCalculator();
+
+            SharedCalculator(const SharedCalculator&) = delete;
+            SharedCalculator& operator=(const SharedCalculator&) = delete;
+
+            // Runs a line as processInput does, writing its output to out, and publishes the
+            // state it leaves. Updates from several threads take turns. Returns false on error.
+            bool update(std::string_view input, std::ostream& out);
+
+            uint64_t getVersion() const { return version_.load(std::memory_order_acquire); }
+
+            // Evaluation on one thread at a time (one Reader per thread). The reader evaluates
+            // against the tables of the last version it saw; only stacks and memo caches are
+            // its own. Moving to a new version takes references, not copies.
+            class Reader {
+                public:
+                    explicit Reader(SharedCalculator& shared);
+
+                    // Both throw CalcError, with the messages processInput reports
+                    double evaluate(std::string_view expression);
+                    double callFunction(const std::string& name, const std::vector<double>& args);
+
+                    // Version the last call evaluated against
+                    uint64_t getVersion() const { return version_; }
+
+                private:
+                    SharedCalculator& shared_;
+                    EpochDomain::Reader epochReader_;
+                    Calculator calculator_;
+                    uint64_t version_{0};
+
+                    void refresh();
+            };
+
+        private:
+            struct Snapshot {
+                uint64_t version;
+                Calculator state;  // shares the writer's tables; never evaluated on
+            };
+
+            std::mutex updateMutex_;
+            Calculator writer_;
+            EpochDomain epochs_;
+            std::atomic<const Snapshot*> current_{nullptr};
+            std::atomic<uint64_t> version_{0};
+
+            void publish();
+    };
+}
\ No newline at end of file
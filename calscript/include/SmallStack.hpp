@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace calc {
+    // Stack of trivially copyable values whose first N elements live inside the object, so
+    // short-lived stacks on the machine stack never touch the heap. Larger sizes move to a
+    // heap buffer that grows by doubling. Elements are left uninitialized until written.
+    template<typename T, size_t N>
+    class SmallStack {
+        static_assert(std::is_trivially_copyable_v<T>, "SmallStack copies elements bytewise");
+        static_assert(N > 0, "SmallStack needs inline capacity");
+
+        public:
+            SmallStack() = default;
+            explicit SmallStack(size_t size) { resize(size); }
+
+            SmallStack(const SmallStack&) = delete;
+            SmallStack& operator=(const SmallStack&) = delete;
+
+            void reserve(size_t capacity) {
+                if (capacity <= capacity_) return;
+                std::unique_ptr<T[]> grown(new T[capacity]);
+                std::copy_n(data_, size_, grown.get());
+                heap_ = std::move(grown);
+                data_ = heap_.get();
+                capacity_ = capacity;
+            }
+
+            void resize(size_t size) {
+                reserve(size);
+                size_ = size;
+            }
+
+            void push_back(const T& value) {
+                if (size_ == capacity_) reserve(capacity_ * 2);
+                data_[size_++] = value;
+            }
+            void pop_back() { size_--; }
+            void clear() { size_ = 0; }
+
+            T& back() { return data_[size_ - 1]; }
+            const T& back() const { return data_[size_ - 1]; }
+            T& operator[](size_t i) { return data_[i]; }
+            const T& operator[](size_t i) const { return data_[i]; }
+            T* data() { return data_; }
+            const T* data() const { return data_; }
+
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            bool isInline() const { return data_ == inline_; }
+
+        private:
+            T inline_[N];
+            std::unique_ptr<T[]> heap_;
+            T* data_{inline_};
+            size_t size_{0};
+            size_t capacity_{N};
+    };
+}
\ No newline at end of file
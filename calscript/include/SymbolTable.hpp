@@ -0,0 +1,139 @@
+#pragma once
+#include "Epoch.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace calc {
+    using SymbolId = uint32_t;
+    constexpr SymbolId NO_SYMBOL = UINT32_MAX;
+
+    // Process-wide string interner. Every name is stored once and referred to by a dense id;
+    // builtin names occupy fixed ids so they can be classified with a single table lookup.
+    // Lookups take no lock: new names are added in place and, when the tables fill up, copied
+    // into larger ones that replace them, with the old tables reclaimed through epochs.
+    class SymbolTable {
+        public:
+            enum class Kind : uint8_t {
+                Name,          // user variable or function
+                Constant,
+                PrevResult,
+                MathFunction,
+                Boolean,
+                Command
+            };
+
+            struct Info {
+                Kind kind;
+                double value;  // for constants and booleans
+            };
+
+            // Ids of the predefined symbols, in registration order
+            enum Builtin : SymbolId {
+                Pi, E, Phi, Sqrt2,
+                Ans,
+                Sin, Cos, Tan, Log, Ln, Sqrt,
+                True, False,
+                Def, Del, Upd, Ls, Create, Use, Memo, Formula, Save, Load, Jit, Prof,
+                BuiltinCount
+            };
+
+            static SymbolTable& global();
+
+            SymbolId intern(std::string_view name);
+            std::optional<SymbolId> lookup(std::string_view name) const;
+            const std::string& name(SymbolId id) const;
+
+            static const Info& info(SymbolId id) {
+                static constexpr Info NAME{Kind::Name, 0.0};
+                return id < BuiltinCount ? BUILTINS[id] : NAME;
+            }
+            static bool isReserved(SymbolId id) { return id < BuiltinCount; }
+
+        private:
+            SymbolTable();
+            ~SymbolTable();
+
+            static const Info BUILTINS[BuiltinCount];
+
+            struct Entry {
+                std::string name;
+                SymbolId id;
+            };
+
+            // Open-addressing hash index (at most half full) and entries by id. Slots only go
+            // from empty to set while a table is current, so readers may probe it at any time.
+            struct Tables {
+                explicit Tables(size_t capacity);
+
+                size_t capacity;  // power of two; ids below capacity / 2 fit
+                std::unique_ptr<std::atomic<const Entry*>[]> index;
+                std::unique_ptr<std::atomic<const Entry*>[]> byId;
+            };
+
+            std::mutex mutex_;             // taken only to add a name
+            std::deque<Entry> entries_;    // deque keeps entries in place as it grows
+            std::atomic<Tables*> tables_;
+            mutable EpochDomain epochs_;   // frees replaced tables once no lookup can be reading them
+
+            static size_t hash(std::string_view name);
+            const Entry* find(const Tables& tables, std::string_view name) const;
+            void insert(Tables& tables, const Entry& entry);
+            EpochDomain::Reader& reader() const;
+    };
+
+    // Dense map from symbol id to value, for per-calculator variables, functions and commands
+    template<typename T>
+    class SymbolMap {
+        public:
+            T* find(SymbolId id) {
+                return id < slots_.size() && slots_[id] ? &*slots_[id] : nullptr;
+            }
+            const T* find(SymbolId id) const {
+                return id < slots_.size() && slots_[id] ? &*slots_[id] : nullptr;
+            }
+            bool contains(SymbolId id) const { return find(id) != nullptr; }
+
+            // Returns false (and leaves the existing value) if id is already present
+            bool insert(SymbolId id, T value) {
+                if (id >= slots_.size()) slots_.resize(id + 1);
+                if (slots_[id]) return false;
+                slots_[id].emplace(std::move(value));
+                count_++;
+                return true;
+            }
+
+            bool erase(SymbolId id) {
+                if (!contains(id)) return false;
+                slots_[id].reset();
+                count_--;
+                return true;
+            }
+
+            void clear() {
+                slots_.clear();
+                count_ = 0;
+            }
+
+            size_t size() const { return count_; }
+            bool empty() const { return count_ == 0; }
+
+            template<typename F>
+            void forEach(F&& f) const {
+                for (SymbolId id = 0; id < slots_.size(); ++id) {
+                    if (slots_[id]) f(id, *slots_[id]);
+                }
+            }
+
+        private:
+            std::vector<std::optional<T>> slots_;
+            size_t count_{0};
+    };
+}
\ No newline at end of file
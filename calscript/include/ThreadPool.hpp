@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace calc {
+    // Fixed set of worker threads, each with its own task queue. A worker takes the newest
+    // task from its own queue and, when that is empty, steals the oldest task from another
+    // worker, so uneven tasks still keep every thread busy.
+    class ThreadPool {
+        public:
+            // Tasks are told which worker runs them, for indexing per-worker state
+            using Task = std::function<void(size_t worker)>;
+
+            explicit ThreadPool(size_t threads);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            size_t size() const { return threads_.size(); }
+
+            void submit(Task task);
+            // Blocks until every submitted task has finished; rethrows the first task exception
+            void wait();
+
+        private:
+            struct Queue {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            std::vector<std::unique_ptr<Queue>> queues_;
+            std::vector<std::thread> threads_;
+
+            std::mutex mutex_;
+            std::condition_variable wake_;   // tasks were queued, or the pool is stopping
+            std::condition_variable done_;   // pending_ dropped to zero
+            std::atomic<size_t> queued_{0};  // tasks sitting in queues
+            size_t pending_{0};              // tasks queued or running
+            size_t next_{0};                 // queue for the next submitted task
+            bool stopping_{false};
+            std::exception_ptr error_;
+
+            bool takeTask(size_t worker, Task& task);
+            void workerLoop(size_t worker);
+    };
+}
\ No newline at end of file
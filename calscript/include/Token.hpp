@@ -1,12 +1,25 @@
 #pragma once 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <stdexcept>
+#include "SymbolTable.hpp"
 
 namespace calc {
+    // Operators and brackets, resolved once by the tokenizer so the compiler never compares text
+    enum class Operator : uint8_t {
+        None,
+        Add, Sub, Mul, Div, Mod, Pow,
+        Factorial, Neg,
+        Sin, Cos, Tan, Log, Ln, Sqrt,
+        LeftParen, RightParen,
+        Count
+    };
+
     class Token {
         public: 
-            enum class Type {
+            enum class Type : uint8_t {
                 Number, 
                 Operator, 
                 Bracket, 
@@ -20,13 +33,45 @@ namespace calc {
                 Colon          // For function definition
             };
 
-            Token (Type t, std::string v) : type_(t), value_(std::move(v)) {}
+            // value must outlive the token: it is a slice of the tokenized text,
+            // an interned name, or a string literal
+            Token (Type t, std::string_view v, SymbolId symbol = NO_SYMBOL, Operator op = Operator::None)
+                : type_(t), op_(op), symbol_(symbol), value_(v) {}
+            Token (Type t, std::string_view v, Operator op)
+                : Token(t, v, NO_SYMBOL, op) {}
+            // Numeric literal, parsed once by the tokenizer
+            Token (std::string_view v, double number)
+                : type_(Type::Number), op_(Operator::None), symbol_(NO_SYMBOL), value_(v), number_(number) {}
             Type getType() const {return type_;}
-            const std::string& getValue() const {return value_;}
+            std::string_view getValue() const {return value_;}
+            SymbolId getSymbol() const {return symbol_;}  // interned name of word tokens; NO_SYMBOL for unknown words
+            Operator getOperator() const {return op_;}  // operators, math functions and brackets
+            double getNumber() const {return number_;}  // value of Number tokens
 
         private:
             Type type_;
-            std::string value_;
+            Operator op_;
+            SymbolId symbol_;
+            std::string_view value_;
+            double number_{0.0};
+    };
+
+    // Contiguous run of tokens stored in the tokenizer's arena
+    class TokenList {
+        public:
+            TokenList() = default;
+            TokenList(const Token* data, size_t size) : data_(data), size_(size) {}
+
+            const Token* begin() const {return data_;}
+            const Token* end() const {return data_ + size_;}
+            const Token& operator[](size_t i) const {return data_[i];}
+            const Token& back() const {return data_[size_ - 1];}
+            size_t size() const {return size_;}
+            bool empty() const {return size_ == 0;}
+
+        private:
+            const Token* data_{nullptr};
+            size_t size_{0};
     };
 
     class CalcError : public std::runtime_error {
@@ -1,24 +1,60 @@
 #pragma once 
 #include "Token.hpp"
 #include "MemoryPool.hpp"
-#include <vector>
+#include <string>
 #include <string_view>
 #include <optional>
 #include <algorithm>
 
 namespace calc {
+    // Tokenizer state: each instance owns the arena its tokens live in, so separate
+    // instances can be used from separate threads without sharing anything.
     class TokenProcessor {
         public: 
-            static std::vector<Token> tokenize(std::string_view expression);
+            TokenProcessor() = default;
+            TokenProcessor(const TokenProcessor&) = delete;
+            TokenProcessor& operator=(const TokenProcessor&) = delete;
+
+            // Whether words that are not names yet are added to the symbol table. Input that is
+            // only evaluated looks words up, so it cannot grow the table: an unknown word becomes
+            // a Variable token without a symbol. Definitions intern every name they mention,
+            // since a function body may read a variable that is defined later.
+            enum class Names : uint8_t { LookUp, Intern };
+
+            // The tokens reference the expression text and live in this tokenizer's arena:
+            // they stay valid while the text is alive and until the enclosing Scope ends.
+            // Calls may nest (e.g. tokenizing a function body while evaluating a line).
+            TokenList tokenize(std::string_view expression, Names names = Names::LookUp);
+
+            // Value of text if it is exactly one numeric literal, optionally signed
+            // (e.g. "-2", "+.5", "1.5e-9"); nullopt for anything else, including out of range values
+            static std::optional<double> parseLiteral(std::string_view text);
+
+            // Releases the tokens produced while it was alive
+            class Scope {
+                public:
+                    explicit Scope(TokenProcessor& tokenizer)
+                        : pool_(tokenizer.pool_), marker_(pool_.mark()) {}
+                    ~Scope() { pool_.rewind(marker_); }
+
+                    Scope(const Scope&) = delete;
+                    Scope& operator=(const Scope&) = delete;
+
+                private:
+                    MemoryPool<Token>& pool_;
+                    MemoryPool<Token>::Marker marker_;
+            };
         
         private:
-            static MemoryPool<Token>& getTokenPool() {
-                static MemoryPool<Token> pool;
-                return pool;
-            }
-            
+            MemoryPool<Token> pool_;
+            std::string lowered_;  // scratch for case-folding words
+
+            static size_t scanNumber(std::string_view input);
+            static std::optional<double> convertNumber(std::string_view text);
             static std::optional<Token> parseNumber(std::string_view& input);
+            static Token numberToken(std::string_view text);
             static bool isOperator(char c);
-            static void handleWord(std::string_view& input, std::vector<Token>& tokens);
+            static Operator operatorFor(char c);
+            Token handleWord(std::string_view& input, Names names);
     };
 }
\ No newline at end of file
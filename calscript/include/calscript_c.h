@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+
+/* C interface to calscript expressions (see Expression.hpp). Functions that can fail return
+   NULL or non-zero and, when error is not NULL, write a NUL-terminated message into
+   error[0..error_size). A compiled expression may be evaluated from several threads at once. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct calscript_expr calscript_expr;
+
+/* Compiles source; variables are numbered in the order they first appear */
+calscript_expr* calscript_compile(const char* source, char* error, size_t error_size);
+void calscript_free(calscript_expr* expr);
+
+size_t calscript_variable_count(const calscript_expr* expr);
+/* Name of variable index, or NULL if index is out of range; valid until the expression is freed */
+const char* calscript_variable_name(const calscript_expr* expr, size_t index);
+
+/* values holds count values in variable order; returns 0 and stores the result on success */
+int calscript_eval(const calscript_expr* expr, const double* values, size_t count, double* result,
+                   char* error, size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
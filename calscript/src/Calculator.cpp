@@ -1,13 +1,19 @@
 #include "Calculator.hpp"
 #include "TokenProcessor.hpp"
+#include "Compiler.hpp"
+#include "Optimizer.hpp"
+#include "FunctionImage.hpp"
+#include "Parser.hpp"
 #include "Constants.hpp"
+#include "Operations.hpp"
+#include "SmallStack.hpp"
 #include <sstream>
 #include <algorithm>
-#include <stack>
 #include <cmath>
-#include <iostream>
 #include <string>
 #include <cctype>
+#include <charconv>
+#include <fstream>
 
 namespace calc {
     // Free function in the namespace
@@ -18,528 +24,232 @@ namespace calc {
                         [](char c){return isalnum(c) || c == '_';});
     }
 
+    // Counts nested calls. Calls can only cycle if functions were deleted and redefined
+    // to call each other, which would otherwise recurse until the stack overflows.
+    class CallDepthGuard {
+        public:
+            CallDepthGuard(size_t& depth, const std::string& name) : depth_(depth) {
+                if (depth_ >= Constants::MAX_CALL_DEPTH) {
+                    throw CalcError("Maximum call depth exceeded in '" + name + "'");
+                }
+                depth_++;
+            }
+            ~CallDepthGuard() { depth_--; }
+
+        private:
+            size_t& depth_;
+    };
+
     // Debug helper to print tokens
-    void printTokens(const std::vector<Token>& tokens) {
-        std::cout << "Tokens: ";
+    void printTokens(std::ostream& out, const TokenList& tokens) {
+        out << "Tokens: ";
         for (const auto& token : tokens) {
-            std::cout << token.getValue() << "(" << static_cast<int>(token.getType()) << ") ";
+            out << token.getValue() << "(" << static_cast<int>(token.getType()) << ") ";
         }
-        std::cout << std::endl;
+        out << '\n';
     }
 
     Calculator::Calculator() {
+        parser_.setProfiler(&profiler_);
         setupCommands();
     }
 
+    // Commands whose arguments are plain words; def, upd, formula, create and use take
+    // expressions and are statements of their own (see processInput)
     void Calculator::setupCommands() {
-        commands_ = {
-            {"del", [this](const auto& args) { handleDelete(args); }},
-            {"upd", [this](const auto& args) {
-                if (args.size() < 2) {
-                    throw CalcError("Usage: upd <variable> <expression>");
-                }
-
-                std::string valueExpr = args[1];
-
-                for (size_t i = 2; i < args.size(); ++i) {
-                    valueExpr += " " + args[i];
-                }
-
-                handleUpdate(args[0], valueExpr);
-            }},
-            {"ls", [this](const auto& args) { handleList(args); }},
-            {"create", [this](const auto& args) {
-                if (args.empty()) {
-                    throw CalcError("Usage: create func <n>(params...): body");
-                }
-
-                if (args[0] == "func") {
-                    // This is handled directly in processInput
-                    throw CalcError("Function creation syntax: create func name(params...): body");
-                } else {
-                    throw CalcError("Unknown create command. Use 'create func'");
-                }
-            }},
-            {"use", [this](const auto& args) {
-                if (args.empty()) {
-                    throw CalcError("Usage: use func <n>(args...)");
-                }
-
-                if (args[0] == "func") {
-                    // This is handled directly in processInput
-                    throw CalcError("Function call syntax: use func name(args...)");
-                } else {
-                    throw CalcError("Unknown use command. Use 'use func'");
-                }
-            }}
-        };
-    }
-
-    void Calculator::processInput(std::string_view input) {
-        if (input.empty()) return;
-
-        try {
-            // Debug command to dump defined functions and their bodies
-            if (input == "debug funcs") {
-                std::cout << "Defined functions:" << std::endl;
-                for (const auto& [name, func] : functions_) {
-                    std::cout << name << "(";
-                    const auto& params = func.getParameters();
-                    for (size_t i = 0; i < params.size(); ++i) {
-                        if (i > 0) std::cout << ", ";
-                        std::cout << params[i];
-                    }
-                    std::cout << "): ";
-                    printTokens(func.getBody());
-                }
-                addToHistory(input);
+        commands_.insert(SymbolTable::Del, [this](const auto& args) { handleDelete(args); });
+        commands_.insert(SymbolTable::Ls, [this](const auto& args) { handleList(args); });
+        commands_.insert(SymbolTable::Memo, [this](const auto& args) {
+            if (args.size() == 2 && args[0] == "off") {
+                disableMemo(std::string(args[1]));
+                *out_ << "Memoization disabled for " << args[1] << '\n';
                 return;
             }
-
-            // Check for function commands
-            if (input.length() >= 12 && std::string(input.substr(0, 12)) == "create func ") {
-                std::string fullCmd = std::string(input);
-
-                // Parse the function definition
-                size_t nameStart = 12; // after "create func "
-                size_t nameEnd = fullCmd.find('(', nameStart);
-
-                if (nameEnd == std::string::npos) {
-                    throw CalcError("Invalid function syntax. Expected '(' after function name.");
-                }
-
-                std::string funcName = fullCmd.substr(nameStart, nameEnd - nameStart);
-                funcName.erase(0, funcName.find_first_not_of(" \t"));
-                funcName.erase(funcName.find_last_not_of(" \t") + 1);
-
-                // Find the closing parenthesis
-                size_t paramsEnd = fullCmd.find(')', nameEnd);
-                if (paramsEnd == std::string::npos) {
-                    throw CalcError("Invalid function syntax. Missing ')' after parameters.");
-                }
-
-                // Extract parameters
-                std::string paramsStr = fullCmd.substr(nameEnd + 1, paramsEnd - nameEnd - 1);
-                std::vector<std::string> params;
-
-                if (!paramsStr.empty()) {
-                    size_t pos = 0;
-                    std::string paramToken = paramsStr;
-                    while ((pos = paramToken.find(',')) != std::string::npos) {
-                        std::string param = paramToken.substr(0, pos);
-                        param.erase(0, param.find_first_not_of(" \t"));
-                        param.erase(param.find_last_not_of(" \t") + 1);
-                        params.push_back(param);
-                        paramToken.erase(0, pos + 1);
+            if ((args.size() == 2 || args.size() == 3) && args[0] == "on") {
+                size_t capacity = Constants::DEFAULT_MEMO_CAPACITY;
+                if (args.size() == 3) {
+                    std::string_view text = args[2];
+                    auto [end, error] = std::from_chars(text.data(), text.data() + text.length(), capacity);
+                    if (error != std::errc() || end != text.data() + text.length() || capacity == 0) {
+                        throw CalcError("Memo capacity must be a positive whole number");
                     }
-
-                    // Add the last parameter
-                    paramToken.erase(0, paramToken.find_first_not_of(" \t"));
-                    paramToken.erase(paramToken.find_last_not_of(" \t") + 1);
-                    if (!paramToken.empty()) {
-                        params.push_back(paramToken);
-                    }
-                }
-
-                // Check for colon
-                size_t colonPos = fullCmd.find(':', paramsEnd);
-                if (colonPos == std::string::npos) {
-                    throw CalcError("Invalid function syntax. Expected ':' after parameters.");
-                }
-
-                // Extract body
-                std::string body = fullCmd.substr(colonPos + 1);
-                body.erase(0, body.find_first_not_of(" \t"));
-
-                if (body.empty()) {
-                    throw CalcError("Function body cannot be empty.");
                 }
-
-                // Tokenize the body
-                auto bodyTokens = TokenProcessor::tokenize(body);
-
-                // Create the function
-                defineFunction(funcName, params, bodyTokens);
-                std::cout << "Defined function " << funcName << "(";
-                for (size_t i = 0; i < params.size(); ++i) {
-                    if (i > 0) std::cout << ", ";
-                    std::cout << params[i];
-                }
-                std::cout << ")" << std::endl;
-
-                addToHistory(input);
+                enableMemo(std::string(args[1]), capacity);
+                *out_ << "Memoization enabled for " << args[1] << " (capacity " << capacity << ")\n";
                 return;
             }
-
-            // Check for function call with "use func" prefix
-            if (input.length() >= 9 && std::string(input.substr(0, 9)) == "use func ") {
-                std::string fullCmd = std::string(input);
-
-                // Parse the function call
-                size_t nameStart = 9; // after "use func "
-                size_t nameEnd = fullCmd.find('(', nameStart);
-
-                if (nameEnd == std::string::npos) {
-                    throw CalcError("Invalid function call syntax. Expected '(' after function name.");
-                }
-
-                std::string funcName = fullCmd.substr(nameStart, nameEnd - nameStart);
-                funcName.erase(0, funcName.find_first_not_of(" \t"));
-                funcName.erase(funcName.find_last_not_of(" \t") + 1);
-
-                // Find the matching closing parenthesis
-                size_t argsEnd = nameEnd + 1;
-                int parenCount = 1;
-
-                while (parenCount > 0 && argsEnd < fullCmd.length()) {
-                    if (fullCmd[argsEnd] == '(') {
-                        parenCount++;
-                    } else if (fullCmd[argsEnd] == ')') {
-                        parenCount--;
-                    }
-                    argsEnd++;
-                }
-
-                if (parenCount > 0) {
-                    throw CalcError("Invalid function call syntax. Missing closing parenthesis.");
-                }
-
-                // Extract and parse arguments
-                std::string argsStr = fullCmd.substr(nameEnd + 1, argsEnd - nameEnd - 2);
-                std::vector<double> argValues;
-
-                if (!argsStr.empty()) {
-                    // Split by commas, but respect nested parentheses
-                    std::vector<std::string> argExpressions;
-                    int nestedParens = 0;
-                    size_t start = 0;
-
-                    for (size_t i = 0; i < argsStr.length(); i++) {
-                        if (argsStr[i] == '(') {
-                            nestedParens++;
-                        } else if (argsStr[i] == ')') {
-                            nestedParens--;
-                        } else if (argsStr[i] == ',' && nestedParens == 0) {
-                            // Found a top-level comma
-                            std::string arg = argsStr.substr(start, i - start);
-                            arg.erase(0, arg.find_first_not_of(" \t"));
-                            arg.erase(arg.find_last_not_of(" \t") + 1);
-                            argExpressions.push_back(arg);
-                            start = i + 1;
-                        }
-                    }
-
-                    // Add the last argument
-                    std::string lastArg = argsStr.substr(start);
-                    lastArg.erase(0, lastArg.find_first_not_of(" \t"));
-                    lastArg.erase(lastArg.find_last_not_of(" \t") + 1);
-                    if (!lastArg.empty()) {
-                        argExpressions.push_back(lastArg);
-                    }
-
-                    // Evaluate each argument
-                    for (const auto& argExpr : argExpressions) {
-                        if (argExpr.empty()) continue;
-
-                        // Handle simple number case
-                        if (argExpr.find_first_not_of("-0123456789.") == std::string::npos) {
-                            argValues.push_back(std::stod(argExpr));
-                        }
-                        // Handle simple variable case
-                        else if (argExpr.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == std::string::npos) {
-                            // Check for constants first
-                            if (argExpr == "pi") {
-                                argValues.push_back(Constants::PI);
-                            } else if (argExpr == "e") {
-                                argValues.push_back(Constants::E);
-                            } else if (argExpr == "phi") {
-                                argValues.push_back(Constants::PHI);
-                            } else if (argExpr == "sqrt2") {
-                                argValues.push_back(Constants::SQRT2);
-                            } else if (argExpr == "ans") {
-                                argValues.push_back(lastResult_);
-                            } else {
-                                auto it = variables_.find(argExpr);
-                                if (it == variables_.end()) {
-                                    throw CalcError("Undefined variable in function argument: " + argExpr);
-                                }
-                                argValues.push_back(it->second);
-                            }
-                        }
-                        // Evaluate the expression
-                        else {
-                            auto tokens = TokenProcessor::tokenize(argExpr);
-                            argValues.push_back(evaluateExpression(tokens));
-                        }
-                    }
-                }
-
-                // Call the function
-                double result = callFunction(funcName, argValues);
-                lastResult_ = result;
-                std::cout << "= " << result << std::endl;
-
-                addToHistory(input, result);
+            throw CalcError("Usage: memo on <function> [capacity] | memo off <function>");
+        });
+        commands_.insert(SymbolTable::Save, [this](const auto& args) {
+            if (args.size() != 2 || args[0] != "funcs") throw CalcError("Usage: save funcs <file>");
+            requireFileAccess();
+            std::string path(args[1]);
+            saveImage(path);
+            *out_ << "Saved " << functions_->size() << " functions and " << variables_->size() << " variables to " << path << '\n';
+        });
+        commands_.insert(SymbolTable::Load, [this](const auto& args) {
+            if (args.size() != 2 || args[0] != "funcs") throw CalcError("Usage: load funcs <file>");
+            requireFileAccess();
+            std::string path(args[1]);
+            size_t functions = functions_->size();
+            size_t variables = variables_->size();
+            loadImage(path);
+            *out_ << "Loaded " << functions_->size() - functions << " functions and " << variables_->size() - variables
+                  << " variables from " << path << '\n';
+        });
+        commands_.insert(SymbolTable::Jit, [this](const auto& args) {
+            if (args.size() != 1 || (args[0] != "on" && args[0] != "off")) throw CalcError("Usage: jit on|off");
+            setJitEnabled(args[0] == "on");
+            *out_ << (jitEnabled_ ? "JIT enabled" : "JIT disabled") << '\n';
+        });
+        commands_.insert(SymbolTable::Prof, [this](const auto& args) {
+#ifdef CALSCRIPT_NO_PROFILE
+            throw CalcError("Profiling is not available in this build");
+#endif
+            if (args.size() == 1 && (args[0] == "on" || args[0] == "off")) {
+                setProfiling(args[0] == "on");
+                *out_ << (args[0] == "on" ? "Profiling started" : "Profiling stopped") << '\n';
                 return;
             }
+            if (args.size() != 2 || args[0] != "dump") throw CalcError("Usage: prof on|off|dump <file>");
+            requireFileAccess();
+
+            std::string path(args[1]);
+            std::ofstream file(path, std::ios::trunc);
+            if (!file) throw CalcError("Cannot open " + path + " for writing");
+            profiler_.writeTrace(file);
+            file.close();
+            if (!file) throw CalcError("Failed to write " + path);
+
+            profiler_.writeTable(*out_);
+            *out_ << "Wrote " << profiler_.getSpanCount() << " spans to " << path << '\n';
+        });
+    }
 
-            // Check for direct function call (without "use func" prefix)
-            // Look for function name followed by opening parenthesis
-            std::string fullCmd = std::string(input);
-            size_t openParenPos = fullCmd.find('(');
-
-            if (openParenPos != std::string::npos && openParenPos > 0) {
-                // Extract potential function name
-                std::string potentialFuncName = fullCmd.substr(0, openParenPos);
-                potentialFuncName.erase(0, potentialFuncName.find_first_not_of(" \t"));
-                potentialFuncName.erase(potentialFuncName.find_last_not_of(" \t") + 1);
-
-                // Check if this is a defined function
-                if (functionExists(potentialFuncName)) {
-                    // Find the matching closing parenthesis
-                    size_t argsEnd = openParenPos + 1;
-                    int parenCount = 1;
-
-                    while (parenCount > 0 && argsEnd < fullCmd.length()) {
-                        if (fullCmd[argsEnd] == '(') {
-                            parenCount++;
-                        } else if (fullCmd[argsEnd] == ')') {
-                            parenCount--;
-                        }
-                        argsEnd++;
-                    }
+    void Calculator::requireFileAccess() const {
+        if (!fileAccess_) throw CalcError("File access is disabled in this session");
+    }
 
-                    if (parenCount > 0) {
-                        throw CalcError("Invalid function call syntax. Missing closing parenthesis.");
-                    }
+    bool Calculator::processInput(std::string_view input, size_t lineNumber) {
+        skippedForAns_ = false;
+        if (input.empty()) return true;
+        CALSCRIPT_PROFILE(&profiler_, Profiler::Phase::Line);
 
-                    // Check if there's anything after the function call
-                    // If there is, we need to treat this as a complex expression
-                    if (argsEnd < fullCmd.length()) {
-                        // There's more after the function call, so it's part of a larger expression
-                        // Tokenize the entire input and use evaluateExpression
-                        auto tokens = TokenProcessor::tokenize(input);
-                        double result = evaluateExpression(tokens);
-                        lastResult_ = result;
-                        std::cout << "= " << result << std::endl;
-                        addToHistory(input, result);
-                        return;
-                    }
+        // Tokens and trees produced for this line are released when it finishes
+        Parser::Scope parseScope(parser_);
 
-                    // Extract arguments
-                    std::string argsStr = fullCmd.substr(openParenPos + 1, argsEnd - openParenPos - 2);
-                    std::vector<double> argValues;
-
-                    if (!argsStr.empty()) {
-                        // Split by commas, but respect nested parentheses
-                        std::vector<std::string> argExpressions;
-                        int nestedParens = 0;
-                        size_t start = 0;
-
-                        for (size_t i = 0; i < argsStr.length(); i++) {
-                            if (argsStr[i] == '(') {
-                                nestedParens++;
-                            } else if (argsStr[i] == ')') {
-                                nestedParens--;
-                            } else if (argsStr[i] == ',' && nestedParens == 0) {
-                                // Found a top-level comma
-                                std::string arg = argsStr.substr(start, i - start);
-                                arg.erase(0, arg.find_first_not_of(" \t"));
-                                arg.erase(arg.find_last_not_of(" \t") + 1);
-                                argExpressions.push_back(arg);
-                                start = i + 1;
-                            }
-                        }
+        try {
+            if (runCachedLine(input)) return true;
 
-                        // Add the last argument
-                        std::string lastArg = argsStr.substr(start);
-                        lastArg.erase(0, lastArg.find_first_not_of(" \t"));
-                        lastArg.erase(lastArg.find_last_not_of(" \t") + 1);
-                        if (!lastArg.empty()) {
-                            argExpressions.push_back(lastArg);
-                        }
+            Statement statement = parser_.parseStatement(input);
+            switch (statement.kind) {
+                case Statement::Kind::Empty:
+                    return true;
 
-                        // Evaluate each argument
-                        for (const auto& argExpr : argExpressions) {
-                            if (argExpr.empty()) continue;
-
-                            // Handle simple number case
-                            if (argExpr.find_first_not_of("-0123456789.") == std::string::npos) {
-                                argValues.push_back(std::stod(argExpr));
-                            }
-                            // Handle simple variable case
-                            else if (argExpr.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == std::string::npos) {
-                                // Check for constants first
-                                if (argExpr == "pi") {
-                                    argValues.push_back(Constants::PI);
-                                } else if (argExpr == "e") {
-                                    argValues.push_back(Constants::E);
-                                } else if (argExpr == "phi") {
-                                    argValues.push_back(Constants::PHI);
-                                } else if (argExpr == "sqrt2") {
-                                    argValues.push_back(Constants::SQRT2);
-                                } else if (argExpr == "ans") {
-                                    argValues.push_back(lastResult_);
-                                } else {
-                                    auto it = variables_.find(argExpr);
-                                    if (it == variables_.end()) {
-                                        throw CalcError("Undefined variable in function argument: " + argExpr);
-                                    }
-                                    argValues.push_back(it->second);
-                                }
-                            }
-                            // Evaluate the expression
-                            else {
-                                auto tokens = TokenProcessor::tokenize(argExpr);
-                                argValues.push_back(evaluateExpression(tokens));
-                            }
+                case Statement::Kind::Expression:
+                case Statement::Kind::UseFunction: {
+                    if (statement.kind == Statement::Kind::UseFunction && !functionExists(std::string(statement.name))) {
+                        throw CalcError("Function not found: " + std::string(statement.name));
+                    }
+                    Program program = compile(parser_.parseExpression(statement.text));
+                    if (!lastResultKnown_) {
+                        std::vector<bool> visited;
+                        if (readsPreviousResult(program, visited)) {
+                            skippedForAns_ = true;
+                            return true;
                         }
                     }
-
-                    // Call the function
-                    double result = callFunction(potentialFuncName, argValues);
+                    double result = run(program);
                     lastResult_ = result;
-                    std::cout << "= " << result << std::endl;
-
+                    lastResultKnown_ = true;
+                    *out_ << "= " << result << '\n';
                     addToHistory(input, result);
-                    return;
-                }
-            }
-
-            // Check for direct def command with raw string splitting to handle spaces correctly
-            if (input.length() >= 4 && std::string(input.substr(0, 4)) == "def ") {
-                std::string fullCmd = std::string(input);
-
-                // Skip the "def " prefix
-                size_t cmdEnd = 4;
-                // Skip any whitespace after "def "
-                while (cmdEnd < fullCmd.length() && std::isspace(fullCmd[cmdEnd])) {
-                    cmdEnd++;
+                    cacheLine(std::move(program), result);
+                    return true;
                 }
 
-                // Find the variable name (until the next whitespace)
-                size_t varStart = cmdEnd;
-                size_t varEnd = fullCmd.find_first_of(" \t", varStart);
-
-                if (varEnd == std::string::npos) {
-                    throw CalcError("Usage: def <variable> <value>");
-                }
-
-                std::string varName = fullCmd.substr(varStart, varEnd - varStart);
-
-                // Skip whitespace after the variable name
-                size_t exprStart = varEnd;
-                while (exprStart < fullCmd.length() && std::isspace(fullCmd[exprStart])) {
-                    exprStart++;
-                }
-
-                // The rest is the expression
-                std::string valueExpr = fullCmd.substr(exprStart);
-
-                if (valueExpr.empty()) {
-                    throw CalcError("Variable definition requires a value.");
-                }
-
-                handleDefine(varName, valueExpr);
-                addToHistory(input);
-                return;
-            }
-
-            // Check for direct upd command with raw string splitting
-            if (input.length() >= 4 && std::string(input.substr(0, 4)) == "upd ") {
-                std::string fullCmd = std::string(input);
-
-                // Skip the "upd " prefix
-                size_t cmdEnd = 4;
-                // Skip any whitespace after "upd "
-                while (cmdEnd < fullCmd.length() && std::isspace(fullCmd[cmdEnd])) {
-                    cmdEnd++;
-                }
-
-                // Find the variable name (until the next whitespace)
-                size_t varStart = cmdEnd;
-                size_t varEnd = fullCmd.find_first_of(" \t", varStart);
-
-                if (varEnd == std::string::npos) {
-                    throw CalcError("Usage: upd <variable> <value>");
-                }
+                case Statement::Kind::Define:
+                    handleDefine(statement.name, statement.text);
+                    break;
 
-                std::string varName = fullCmd.substr(varStart, varEnd - varStart);
+                case Statement::Kind::Update:
+                    handleUpdate(statement.name, statement.text);
+                    break;
 
-                // Skip whitespace after the variable name
-                size_t exprStart = varEnd;
-                while (exprStart < fullCmd.length() && std::isspace(fullCmd[exprStart])) {
-                    exprStart++;
+                case Statement::Kind::Formula: {
+                    std::string name(statement.name);
+                    defineFormula(name, statement.text);
+                    *out_ << "Formula " << name << " = " << *variables_->find(SymbolTable::global().intern(name)) << '\n';
+                    break;
                 }
 
-                // The rest is the expression
-                std::string valueExpr = fullCmd.substr(exprStart);
-
-                if (valueExpr.empty()) {
-                    throw CalcError("Variable update requires a value.");
+                case Statement::Kind::CreateFunction: {
+                    std::string name(statement.name);
+                    std::vector<std::string> params(statement.words.begin(), statement.words.end());
+                    defineFunction(name, params, statement.text);
+                    *out_ << "Defined function " << name << "(";
+                    for (size_t i = 0; i < params.size(); ++i) {
+                        if (i > 0) *out_ << ", ";
+                        *out_ << params[i];
+                    }
+                    *out_ << ")\n";
+                    break;
                 }
 
-                handleUpdate(varName, valueExpr);
-                addToHistory(input);
-                return;
-            }
-
-            // Normal expression or command
-            auto tokens = TokenProcessor::tokenize(input);
-            if (tokens.empty()) return;
-
-            if (tokens[0].getType() == Token::Type::Command) {
-                const std::string& cmd = tokens[0].getValue();
+                case Statement::Kind::Command:
+                    handleCommand(statement.command, statement.words);
+                    break;
 
-                // Other commands (not def or upd which are handled above)
-                std::vector<std::string> args;
-                for (size_t i = 1; i < tokens.size(); i++) {
-                    args.push_back(tokens[i].getValue());
-                }
-                handleCommand(cmd, args);
-                addToHistory(input);
-            }
-            else {
-                try {
-                    double result = evaluateExpression(tokens);
-                    lastResult_ = result;
-                    std::cout << "= " << result << std::endl;
-                    addToHistory(input, result);
-                } catch (const CalcError& e) {
-                    throw; // Just rethrow the error
-                } catch (const std::exception& e) {
-                    throw CalcError(e.what());
-                }
+                case Statement::Kind::DebugFunctions:
+                    // Dumps defined functions and the tokens of their bodies
+                    *out_ << "Defined functions:\n";
+                    functions_->forEach([this, &out = *out_](SymbolId, const Function& func) {
+                        out << func.getName() << "(";
+                        const auto& params = func.getParameters();
+                        for (size_t i = 0; i < params.size(); ++i) {
+                            if (i > 0) out << ", ";
+                            out << params[i];
+                        }
+                        out << "): ";
+                        printTokens(out, parser_.getTokenizer().tokenize(func.getBody()));
+                    });
+                    break;
             }
+            addToHistory(input);
         }
         catch (const CalcError& e) {
-            std::cout << "Error: " << e.what() << std::endl;
+            *out_ << "Error";
+            if (lineNumber > 0) *out_ << " (line " << lineNumber << ")";
+            *out_ << ": " << e.what() << '\n';
             addToHistory(input);
+            return false;
         }
+
+        return true;
     }
 
-    void Calculator::handleDefine(const std::string& varName, const std::string& valueExpr) {
-        if (!isValidVariableName(varName)) {
+    void Calculator::handleDefine(std::string_view varName, std::string_view valueExpr) {
+        if (!isValidVariableName(std::string(varName))) {
             throw CalcError("Invalid variable name. Must start with a letter and contain only letters, numbers, or underscores.");
         }
 
-        // Check if the name is a constant
-        if (varName == "pi" || varName == "e" || varName == "phi" || varName == "sqrt2" || varName == "ans") {
-            throw CalcError("Cannot use constant '" + varName + "' as a variable name.");
+        // Only looked up: defineVariable adds the name once the value has been computed
+        SymbolId id = SymbolTable::global().lookup(varName).value_or(NO_SYMBOL);
+        SymbolTable::Kind kind = SymbolTable::info(id).kind;
+
+        if (kind == SymbolTable::Kind::Constant || kind == SymbolTable::Kind::PrevResult) {
+            throw CalcError("Cannot use constant '" + std::string(varName) + "' as a variable name.");
         }
 
-        // Check if the name is a math function
-        if (varName == "sin" || varName == "cos" || varName == "tan" ||
-            varName == "log" || varName == "ln" || varName == "sqrt") {
-            throw CalcError("Cannot use math function '" + varName + "' as a variable name.");
+        if (kind == SymbolTable::Kind::MathFunction) {
+            throw CalcError("Cannot use math function '" + std::string(varName) + "' as a variable name.");
         }
 
-        if (commands_.find(varName) != commands_.end() ||
-            functions_.count(varName) > 0) {
-            throw CalcError("Name '" + varName + "' is already used as a command or function name.");
+        if (kind == SymbolTable::Kind::Command || functions_->contains(id)) {
+            throw CalcError("Name '" + std::string(varName) + "' is already used as a command or function name.");
         }
 
-        if (variables_.count(varName) > 0) {
+        if (variables_->contains(id)) {
             throw CalcError("Variable already exists. Use 'upd' to modify it.");
         }
 
@@ -548,83 +258,39 @@ namespace calc {
         }
 
         try {
-            // Handle direct number case (this covers both positive and negative)
-            if (valueExpr.find_first_not_of("+-0123456789.") == std::string::npos) {
-                double value = std::stod(valueExpr);
-                defineVariable(varName, value);
-                std::cout << "Defined " << varName << " = " << value << std::endl;
-                return;
-            }
-
-            // Handle direct variable reference (no spaces or operators)
-            if (valueExpr.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == std::string::npos) {
-                // Check if it's a constant
-                if (valueExpr == "pi") {
-                    defineVariable(varName, Constants::PI);
-                    std::cout << "Defined " << varName << " = " << Constants::PI << std::endl;
-                    return;
-                }
-                else if (valueExpr == "e") {
-                    defineVariable(varName, Constants::E);
-                    std::cout << "Defined " << varName << " = " << Constants::E << std::endl;
-                    return;
-                }
-                else if (valueExpr == "phi") {
-                    defineVariable(varName, Constants::PHI);
-                    std::cout << "Defined " << varName << " = " << Constants::PHI << std::endl;
-                    return;
-                }
-                else if (valueExpr == "sqrt2") {
-                    defineVariable(varName, Constants::SQRT2);
-                    std::cout << "Defined " << varName << " = " << Constants::SQRT2 << std::endl;
-                    return;
-                }
-                else if (valueExpr == "ans") {
-                    defineVariable(varName, lastResult_);
-                    std::cout << "Defined " << varName << " = " << lastResult_ << std::endl;
-                    return;
-                }
-
-                // Check if it's a variable
-                auto it = variables_.find(valueExpr);
-                if (it != variables_.end()) {
-                    defineVariable(varName, it->second);
-                    std::cout << "Defined " << varName << " = " << it->second << std::endl;
-                    return;
-                } else {
-                    throw CalcError("Undefined variable: " + valueExpr);
-                }
-            }
-
-            // For complex expressions, use the tokenizer and evaluator
-            auto tokens = TokenProcessor::tokenize(valueExpr);
-            if (tokens.empty()) {
-                throw CalcError("Empty expression");
-            }
-
-            double value = evaluateExpression(tokens);
+            // Plain literals (including a leading '+') skip the parser
+            auto literal = TokenProcessor::parseLiteral(valueExpr);
+            double value = literal ? *literal : evaluateExpression(parser_.parseExpression(valueExpr));
             defineVariable(varName, value);
-            std::cout << "Defined " << varName << " = " << value << std::endl;
+            *out_ << "Defined " << varName << " = " << value << '\n';
         } catch (const std::exception& e) {
             throw CalcError("Invalid expression: " + std::string(e.what()));
         }
     }
 
-    void Calculator::handleCommand(std::string_view cmd, const std::vector<std::string>& args) {
-        if (cmd == "def" || cmd == "upd") {
-            throw CalcError("Internal error: " + std::string(cmd) + " command should be handled separately");
-        }
-
-        auto it = commands_.find(std::string(cmd));
-        if (it != commands_.end()) {
-            it->second(args);
+    void Calculator::handleCommand(SymbolId cmd, const std::vector<std::string_view>& args) {
+        if (const CommandHandler* handler = commands_.find(cmd)) {
+            (*handler)(args);
         } else {
-            throw CalcError("Unknown command: " + std::string(cmd));
+            throw CalcError("Unknown command: " + SymbolTable::global().name(cmd));
         }
     }
 
-    void Calculator::handleUpdate(const std::string& varName, const std::string& valueExpr) {
-        if (variables_.find(varName) == variables_.end()) {
+    std::optional<double> Calculator::lookupValue(std::string_view name) const {
+        auto id = SymbolTable::global().lookup(name);
+        if (!id) return std::nullopt;
+
+        const auto& info = SymbolTable::info(*id);
+        if (info.kind == SymbolTable::Kind::Constant) return info.value;
+        if (info.kind == SymbolTable::Kind::PrevResult) return lastResult_;
+
+        if (const double* value = variables_->find(*id)) return *value;
+        return std::nullopt;
+    }
+
+    void Calculator::handleUpdate(std::string_view varName, std::string_view valueExpr) {
+        auto id = SymbolTable::global().lookup(varName);
+        if (!id || !variables_->contains(*id)) {
             throw CalcError("Variable does not exist. Use 'def' to create it.");
         }
 
@@ -633,96 +299,44 @@ namespace calc {
         }
 
         try {
-            // Handle direct number case (this covers both positive and negative)
-            if (valueExpr.find_first_not_of("+-0123456789.") == std::string::npos) {
-                double value = std::stod(valueExpr);
-                updateVariable(varName, value);
-                std::cout << "Updated " << varName << " = " << value << std::endl;
-                return;
-            }
-
-            // Handle direct variable reference (no spaces or operators)
-            if (valueExpr.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_") == std::string::npos) {
-                // Check if it's a constant
-                if (valueExpr == "pi") {
-                    updateVariable(varName, Constants::PI);
-                    std::cout << "Updated " << varName << " = " << Constants::PI << std::endl;
-                    return;
-                }
-                else if (valueExpr == "e") {
-                    updateVariable(varName, Constants::E);
-                    std::cout << "Updated " << varName << " = " << Constants::E << std::endl;
-                    return;
-                }
-                else if (valueExpr == "phi") {
-                    updateVariable(varName, Constants::PHI);
-                    std::cout << "Updated " << varName << " = " << Constants::PHI << std::endl;
-                    return;
-                }
-                else if (valueExpr == "sqrt2") {
-                    updateVariable(varName, Constants::SQRT2);
-                    std::cout << "Updated " << varName << " = " << Constants::SQRT2 << std::endl;
-                    return;
-                }
-                else if (valueExpr == "ans") {
-                    updateVariable(varName, lastResult_);
-                    std::cout << "Updated " << varName << " = " << lastResult_ << std::endl;
-                    return;
-                }
-
-                // Check if it's a variable
-                auto it = variables_.find(valueExpr);
-                if (it != variables_.end()) {
-                    updateVariable(varName, it->second);
-                    std::cout << "Updated " << varName << " = " << it->second << std::endl;
-                    return;
-                } else {
-                    throw CalcError("Undefined variable: " + valueExpr);
-                }
-            }
-
-            // For complex expressions, use the tokenizer and evaluator
-            auto tokens = TokenProcessor::tokenize(valueExpr);
-            if (tokens.empty()) {
-                throw CalcError("Empty expression");
-            }
-
-            double value = evaluateExpression(tokens);
+            // Plain literals (including a leading '+') skip the parser
+            auto literal = TokenProcessor::parseLiteral(valueExpr);
+            double value = literal ? *literal : evaluateExpression(parser_.parseExpression(valueExpr));
             updateVariable(varName, value);
-            std::cout << "Updated " << varName << " = " << value << std::endl;
+            *out_ << "Updated " << varName << " = " << value << '\n';
         } catch (const std::exception& e) {
             throw CalcError("Invalid expression: " + std::string(e.what()));
         }
     }
 
-    void Calculator::handleDelete(const std::vector<std::string>& args) {
+    void Calculator::handleDelete(const std::vector<std::string_view>& args) {
         if (args.empty()) {
             throw CalcError("Usage: del <variable|hist|func|vars>");
         }
 
         if (args[0] == "hist") {
             clearHistory();
-            std::cout << "History cleared" << std::endl;
+            *out_ << "History cleared\n";
         }
         else if (args[0] == "vars") {
             deleteAllVariables();
-            std::cout << "Variables cleared" << std::endl;
+            *out_ << "Variables cleared\n";
         }
         else if (args[0] == "func" && args.size() > 1) {
-            deleteFunction(args[1]);
-            std::cout << "Deleted function " << args[1] << std::endl;
+            deleteFunction(std::string(args[1]));
+            *out_ << "Deleted function " << args[1] << '\n';
         }
         else {
             deleteVariable(args[0]);
-            std::cout << "Deleted variable " << args[0] << std::endl;
+            *out_ << "Deleted variable " << args[0] << '\n';
         }
     }
 
 
-    void Calculator::handleList(const std::vector<std::string>& args) {
+    void Calculator::handleList(const std::vector<std::string_view>& args) {
         if (args.empty()) {
             // If no args, show all categories
-            std::cout << "Available categories: vars, hist, funcs" << std::endl;
+            *out_ << "Available categories: vars, hist, funcs\n";
             return;
         }
 
@@ -731,70 +345,249 @@ namespace calc {
         }
 
         if (args[0] == "vars") {
-            std::cout << "Variables:" << std::endl;
-            if (variables_.empty()) {
-                std::cout << "  No variables defined" << std::endl;
+            *out_ << "Variables:\n";
+            if (variables_->empty()) {
+                *out_ << "  No variables defined\n";
                 return;
             }
-            for (const auto& [name, value] : variables_) {
-                std::cout << name << " = " << value << std::endl;
-            }
+            variables_->forEach([this, &out = *out_](SymbolId id, double value) {
+                out << SymbolTable::global().name(id) << " = " << value;
+                if (const Formula* formula = formulas_->find(id)) {
+                    out << " [formula: " << formula->expression << "]";
+                }
+                out << '\n';
+            });
         }
         else if (args[0] == "hist") {
-            std::cout << "History:" << std::endl;
+            *out_ << "History:\n";
             if (history_.empty()) {
-                std::cout << "  No history" << std::endl;
+                *out_ << "  No history\n";
                 return;
             }
             for (const auto& entry : history_) {
-                std::cout << entry.input;
+                *out_ << entry.input;
                 if(entry.result) {
-                    std::cout << " = " << *entry.result;
+                    *out_ << " = " << *entry.result;
                 }
-                std::cout << std::endl;
+                *out_ << '\n';
             }
         }
         else if (args[0] == "funcs") {
-            std::cout << "Functions:" << std::endl;
-            if (functions_.empty()) {
-                std::cout << "  No functions defined" << std::endl;
+            *out_ << "Functions:\n";
+            if (functions_->empty()) {
+                *out_ << "  No functions defined\n";
                 return;
             }
-            for (const auto& [name, func] : functions_) {
-                std::cout << name << "(";
+            functions_->forEach([this, &out = *out_](SymbolId id, const Function& func) {
+                out << func.getName() << "(";
                 const auto& params = func.getParameters();
                 for (size_t i = 0; i < params.size(); ++i) {
-                    if (i > 0) std::cout << ", ";
-                    std::cout << params[i];
+                    if (i > 0) out << ", ";
+                    out << params[i];
                 }
-                std::cout << ")" << std::endl;
-            }
+                out << ")";
+                if (const MemoCache* memo = memos_.find(id)) {
+                    out << " [memo: " << memo->getHits() << " hits, " << memo->getMisses() << " misses, "
+                        << memo->size() << "/" << memo->getCapacity() << " entries]";
+                }
+                out << '\n';
+            });
         }
         else {
             throw CalcError("Invalid list command. Use 'vars', 'hist', or 'funcs'");
         }
     }
 
+    std::unordered_map<std::string, double> Calculator::getVariables() const {
+        std::unordered_map<std::string, double> result;
+        variables_->forEach([&result](SymbolId id, double value) {
+            result.emplace(SymbolTable::global().name(id), value);
+        });
+        return result;
+    }
+
     void Calculator::defineVariable(std::string_view name, double value) {
-        variables_.emplace(std::string(name), value);
+        SymbolId id = SymbolTable::global().intern(name);
+        variables_.edit().insert(id, value);
+        touchVariable(id);
+        recomputeDependents(id);
     }
 
     void Calculator::deleteVariable(std::string_view name) {
-        if(variables_.erase(std::string(name)) == 0) {
+        auto id = SymbolTable::global().lookup(name);
+        if (!id || !variables_.edit().erase(*id)) {
             throw CalcError("Variable not found");
         }
+        unlinkFormula(*id);
+        touchVariable(*id);
+        recomputeDependents(*id);
     }
 
     void Calculator::deleteAllVariables() {
-        variables_.clear();
+        variables_->forEach([this](SymbolId id, double) { touchVariable(id); });
+        variables_.edit().clear();
+        formulas_.edit().clear();
+        dependents_.edit().clear();
     }
 
     void Calculator::updateVariable(std::string_view name, double value) {
-        auto it = variables_.find(std::string(name));
-        if (it == variables_.end()) {
+        auto id = SymbolTable::global().lookup(name);
+        double* variable = id ? variables_.edit().find(*id) : nullptr;
+        if (!variable) {
             throw CalcError("Variable not found");
         }
-        it->second = value;
+        *variable = value;
+        // An explicit value replaces a formula, like typing over a spreadsheet cell
+        unlinkFormula(*id);
+        touchVariable(*id);
+        recomputeDependents(*id);
+    }
+
+    // Invalidates memoized results and cached lines that read the variable
+    void Calculator::touchVariable(SymbolId id) {
+        if (id >= variableVersions_.size()) variableVersions_.resize(id + 1);
+        variableVersions_[id]++;
+        stateEpoch_++;
+    }
+
+    void Calculator::defineFormula(const std::string& name, std::string_view expression) {
+        if (!isValidVariableName(name)) {
+            throw CalcError("Invalid variable name. Must start with a letter and contain only letters, numbers, or underscores.");
+        }
+
+        SymbolId id = SymbolTable::global().intern(name);
+        if (SymbolTable::info(id).kind != SymbolTable::Kind::Name) {
+            throw CalcError("Cannot use '" + name + "' as a variable name.");
+        }
+        if (functions_->contains(id)) {
+            throw CalcError("Name '" + name + "' is already used as a function name.");
+        }
+
+        Formula formula = compileFormula(id, expression);
+        double value = run(formula.program);
+
+        linkFormula(id, std::move(formula));
+        if (double* variable = variables_.edit().find(id)) {
+            *variable = value;
+        } else {
+            variables_.edit().insert(id, value);
+        }
+        touchVariable(id);
+        recomputeDependents(id);
+    }
+
+    Calculator::Formula Calculator::compileFormula(SymbolId id, std::string_view expression) {
+        Parser::Scope parseScope(parser_);
+        Formula formula{std::string(expression), compile(parser_.parseExpression(expression, TokenProcessor::Names::Intern)), {}};
+
+        std::vector<bool> visited;
+        bool readsAns = false;
+        collectDependencies(formula.program, formula.inputs, visited, readsAns);
+        if (readsAns) {
+            throw CalcError("Formulas cannot use ans");
+        }
+        for (SymbolId func = 0; func < visited.size(); ++func) {
+            if (visited[func]) formula.inputs.push_back(func);
+        }
+        std::sort(formula.inputs.begin(), formula.inputs.end());
+        formula.inputs.erase(std::unique(formula.inputs.begin(), formula.inputs.end()), formula.inputs.end());
+
+        // Reject the formula if anything it reads is itself computed from this variable
+        std::vector<char> state;
+        std::vector<SymbolId> downstream;
+        sortDependents(id, state, downstream);
+        for (SymbolId reached : downstream) {
+            if (reached == id && std::binary_search(formula.inputs.begin(), formula.inputs.end(), id)) {
+                throw CalcError("Circular reference: '" + SymbolTable::global().name(id) + "' refers to itself");
+            }
+            if (std::binary_search(formula.inputs.begin(), formula.inputs.end(), reached)) {
+                throw CalcError("Circular reference: '" + SymbolTable::global().name(id) +
+                                "' would depend on itself through '" + SymbolTable::global().name(reached) + "'");
+            }
+        }
+        return formula;
+    }
+
+    // Installs formula for id, replacing any previous one, and records which inputs it reads
+    void Calculator::linkFormula(SymbolId id, Formula formula) {
+        unlinkFormula(id);
+        auto& dependents = dependents_.edit();
+        for (SymbolId input : formula.inputs) {
+            if (input >= dependents.size()) dependents.resize(input + 1);
+            dependents[input].push_back(id);
+        }
+        formulas_.edit().insert(id, std::move(formula));
+    }
+
+    void Calculator::unlinkFormula(SymbolId id) {
+        const Formula* formula = formulas_->find(id);
+        if (!formula) return;
+        auto& dependents = dependents_.edit();
+        for (SymbolId input : formula->inputs) {
+            auto& readers = dependents[input];
+            readers.erase(std::remove(readers.begin(), readers.end(), id), readers.end());
+        }
+        formulas_.edit().erase(id);
+    }
+
+    // A function's body decides what its callers read, and whether a name followed by '('
+    // is a call at all, so formulas that use the changed name are compiled again
+    void Calculator::refreshFormulas(SymbolId changed) {
+        if (changed >= dependents_->size() || (*dependents_)[changed].empty()) return;
+
+        std::vector<SymbolId> readers = (*dependents_)[changed];
+        for (SymbolId id : readers) {
+            try {
+                linkFormula(id, compileFormula(id, formulas_->find(id)->expression));
+            } catch (const CalcError& e) {
+                *out_ << "Warning: formula " << SymbolTable::global().name(id) << " kept its previous definition: "
+                      << e.what() << '\n';
+            }
+        }
+        recomputeDependents(changed);
+    }
+
+    // Re-evaluates every formula downstream of changed, each after all of its inputs
+    void Calculator::recomputeDependents(SymbolId changed) {
+        if (changed >= dependents_->size() || (*dependents_)[changed].empty()) return;
+
+        std::vector<char> state;
+        std::vector<SymbolId> order;
+        sortDependents(changed, state, order);
+        order.pop_back();  // changed itself, which finishes last
+
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            SymbolId id = *it;
+            try {
+                double value = run(formulas_->find(id)->program);
+                if (double* variable = variables_.edit().find(id)) {
+                    *variable = value;
+                } else {
+                    variables_.edit().insert(id, value);
+                }
+                touchVariable(id);
+            } catch (const CalcError& e) {
+                // The variable keeps its last value; the change that caused this still stands
+                *out_ << "Warning: could not recompute " << SymbolTable::global().name(id) << ": " << e.what() << '\n';
+            }
+        }
+    }
+
+    // Depth-first walk over the formulas that read id, appending each after everything
+    // downstream of it, so the reverse of order is a topological order
+    void Calculator::sortDependents(SymbolId id, std::vector<char>& state, std::vector<SymbolId>& order) const {
+        if (id >= state.size()) state.resize(id + 1, 0);
+        if (state[id] == 2) return;
+        if (state[id] == 1) {
+            throw CalcError("Circular reference between formulas involving '" + SymbolTable::global().name(id) + "'");
+        }
+
+        state[id] = 1;
+        if (id < dependents_->size()) {
+            for (SymbolId reader : (*dependents_)[id]) sortDependents(reader, state, order);
+        }
+        state[id] = 2;
+        order.push_back(id);
     }
 
     void Calculator::addToHistory(std::string_view input, std::optional<double> result) {
@@ -807,60 +600,33 @@ namespace calc {
         if(history_.size() > Constants::MAX_HISTORY) history_.pop_front();
     }
 
-    void Calculator::clearHistory() {
-        history_.clear();
+    void Calculator::appendHistory(const HistoryEntry& entry) {
+        history_.push_back(entry);
+        if(history_.size() > Constants::MAX_HISTORY) history_.pop_front();
     }
 
-    double Calculator::evaluateMathFunction(const std::string& func, double arg) {
-        constexpr double DEG_TO_RAD = Constants::PI / 180.0;
-        constexpr double EPSILON = 1e-10;
-        if (func == "sin") {
-            double result = std::sin(arg * DEG_TO_RAD);
-            if(std::abs(result) < EPSILON) return 0;
-            if(std::abs(result - 1) < EPSILON) return 1;
-            if(std::abs(result + 1) < EPSILON) return -1;
-            return result;
-        }
-        if (func == "cos") {
-            double result = std::cos(arg * DEG_TO_RAD);
-            if(std::abs(result) < EPSILON) return 0;
-            if(std::abs(result - 1) < EPSILON) return 1;
-            if(std::abs(result + 1) < EPSILON) return -1;
-            return result;
-        }
-        if (func == "tan") {
-            if(std::fmod(std::abs(arg), 180) == 90) {
-                throw CalcError("Tangent undefined at 90 (and its odd multiples)");
-            }
-            return std::tan(arg * DEG_TO_RAD);
-        }
-        if (func == "log") return std::log10(arg);
-        if (func == "ln") return std::log(arg);
-        if (func == "sqrt") {
-            if (arg < 0) throw CalcError("Square root of negative number");
-            return std::sqrt(arg);
-        }
-        throw CalcError("Unknown function: " + func);
+    void Calculator::clearHistory() {
+        history_.clear();
     }
 
     // Function-related methods
-    void Calculator::defineFunction(const std::string& name, const std::vector<std::string>& params, const std::vector<Token>& body) {
+    void Calculator::defineFunction(const std::string& name, const std::vector<std::string>& params, std::string_view body) {
         if (!isValidVariableName(name)) {
             throw CalcError("Invalid function name. Must start with a letter and contain only letters, numbers, or underscores.");
         }
 
-        // Check if name is a constant
-        if (name == "pi" || name == "e" || name == "phi" || name == "sqrt2" || name == "ans") {
+        SymbolId id = SymbolTable::global().intern(name);
+        SymbolTable::Kind kind = SymbolTable::info(id).kind;
+
+        if (kind == SymbolTable::Kind::Constant || kind == SymbolTable::Kind::PrevResult) {
             throw CalcError("Cannot use constant '" + name + "' as a function name.");
         }
 
-        // Check if name is a math function
-        if (name == "sin" || name == "cos" || name == "tan" ||
-            name == "log" || name == "ln" || name == "sqrt") {
+        if (kind == SymbolTable::Kind::MathFunction) {
             throw CalcError("Cannot use math function '" + name + "' as a function name.");
         }
 
-        if (variables_.count(name) > 0 || functions_.count(name) > 0) {
+        if (variables_->contains(id) || functions_->contains(id)) {
             throw CalcError("Function/variable name '" + name + "' already exists.");
         }
 
@@ -871,7 +637,8 @@ namespace calc {
             }
 
             // Check if parameter name is a reserved constant
-            if (param == "pi" || param == "e" || param == "phi" || param == "sqrt2" || param == "ans") {
+            auto paramKind = SymbolTable::info(SymbolTable::global().intern(param)).kind;
+            if (paramKind == SymbolTable::Kind::Constant || paramKind == SymbolTable::Kind::PrevResult) {
                 throw CalcError("Cannot use constant '" + param + "' as a parameter name.");
             }
         }
@@ -885,393 +652,752 @@ namespace calc {
             paramCheck[param] = true;
         }
 
-        functions_.emplace(name, Function(name, params, body));
+        Parser::Scope parseScope(parser_);
+        const Expr& tree = parser_.parseExpression(body, TokenProcessor::Names::Intern);
+        CALSCRIPT_PROFILE(&profiler_, Profiler::Phase::Compile);
+        // Bodies run many times, so they are worth simplifying once up front
+        Program program = Optimizer::optimize(Compiler::compile(tree, params));
+        functions_.edit().insert(id, Function(name, params, std::string(body), std::move(program)));
+        stateEpoch_++;
+        functionEpoch_++;
+        relinkCallers(id);
+        refreshFormulas(id);
+    }
+
+    // Re-inlines the function that changed and every function that calls it
+    void Calculator::relinkCallers(SymbolId changed) {
+        std::vector<SymbolId> stale;
+        functions_->forEach([&](SymbolId id, const Function& func) {
+            const auto& callees = func.getCallees();
+            if (id == changed || std::binary_search(callees.begin(), callees.end(), changed)) {
+                stale.push_back(id);
+            }
+        });
+        relink(stale);
+    }
+
+    void Calculator::relink(const std::vector<SymbolId>& ids) {
+        for (SymbolId id : ids) {
+            Function* func = functions_.edit().find(id);
+            std::vector<SymbolId> callees;
+            Program program = Optimizer::inlineCalls(func->getBaseProgram(), *this, callees);
+            func->link(std::move(program), std::move(callees));
+        }
+
+        // Whether a memoized function reads ans can change with any function it calls
+        std::vector<SymbolId> memoized;
+        memos_.forEach([&memoized](SymbolId id, const MemoCache&) { memoized.push_back(id); });
+        for (SymbolId id : memoized) {
+            std::vector<bool> visited;
+            memos_.find(id)->setReadsAns(readsPreviousResult(id, visited));
+        }
     }
 
     void Calculator::deleteFunction(const std::string& name) {
-        if (functions_.erase(name) == 0) {
+        auto id = SymbolTable::global().lookup(name);
+        if (!id || !functions_.edit().erase(*id)) {
             throw CalcError("Function not found: " + name);
         }
+        memos_.erase(*id);
+        stateEpoch_++;
+        functionEpoch_++;
+        relinkCallers(*id);
+        refreshFormulas(*id);
+    }
+
+    void Calculator::saveImage(const std::string& path) const {
+        FunctionImageWriter writer;
+        functions_->forEach([&writer](SymbolId id, const Function& func) {
+            writer.addFunction(id, func.getParameters(), func.getBody(), func.getBaseProgram());
+        });
+        variables_->forEach([&writer](SymbolId id, double value) { writer.addVariable(id, value); });
+        formulas_->forEach([&writer](SymbolId id, const Formula& formula) { writer.addFormula(id, formula.expression); });
+        writer.write(path);
+    }
+
+    void Calculator::loadImage(const std::string& path) {
+        FunctionImage image(path);
+        SymbolTable& symbols = SymbolTable::global();
+
+        // Names are checked before anything is installed, so a failed load changes nothing
+        std::vector<bool> claimed;
+        auto claim = [&](SymbolId id) {
+            if (SymbolTable::info(id).kind != SymbolTable::Kind::Name) {
+                throw CalcError("Cannot load '" + symbols.name(id) + "': the name is reserved.");
+            }
+            if (id >= claimed.size()) claimed.resize(id + 1);
+            if (claimed[id] || variables_->contains(id) || functions_->contains(id)) {
+                throw CalcError("Function/variable name '" + symbols.name(id) + "' already exists.");
+            }
+            claimed[id] = true;
+        };
+        for (const auto& func : image.getFunctions()) {
+            claim(func.name);
+            for (auto param = func.params.begin(); param != func.params.end(); ++param) {
+                auto kind = SymbolTable::info(*param).kind;
+                if (kind == SymbolTable::Kind::Constant || kind == SymbolTable::Kind::PrevResult) {
+                    throw CalcError("Cannot use constant '" + symbols.name(*param) + "' as a parameter name.");
+                }
+                if (std::find(func.params.begin(), param, *param) != param) {
+                    throw CalcError("Duplicate parameter name: " + symbols.name(*param));
+                }
+            }
+        }
+        for (const auto& variable : image.getVariables()) claim(variable.first);
+
+        for (const auto& [id, value] : image.getVariables()) {
+            variables_.edit().insert(id, value);
+            touchVariable(id);
+        }
+
+        // Bodies arrive compiled; they are linked once all of them are in, rather than
+        // relinking callers after each one as defineFunction does
+        std::vector<SymbolId> loaded;
+        for (const auto& func : image.getFunctions()) {
+            std::vector<std::string> params;
+            for (SymbolId param : func.params) params.push_back(symbols.name(param));
+            functions_.edit().insert(func.name, Function(symbols.name(func.name), std::move(params),
+                                                  std::string(func.body), func.program));
+            loaded.push_back(func.name);
+        }
+        stateEpoch_++;
+        functionEpoch_++;
+        relink(loaded);
+
+        // Formula variables already hold their saved values; this restores their expressions
+        for (const auto& [id, expression] : image.getFormulas()) {
+            defineFormula(symbols.name(id), expression);
+        }
     }
 
     bool Calculator::functionExists(const std::string& name) const {
-        return functions_.count(name) > 0;
+        auto id = SymbolTable::global().lookup(name);
+        return id && functions_->contains(*id);
     }
 
     double Calculator::callFunction(const std::string& name, const std::vector<double>& args) {
-        auto it = functions_.find(name);
-        if (it == functions_.end()) {
+        auto id = SymbolTable::global().lookup(name);
+        const Function* func = id ? functions_->find(*id) : nullptr;
+        if (!func) {
             throw CalcError("Function not found: " + name);
         }
 
-        const auto& func = it->second;
-        const auto& params = func.getParameters();
+        return invokeFunction(*id, *func, args.data(), args.size());
+    }
+
+    std::vector<double> Calculator::callFunctionBatch(const std::string& name,
+                                                      const std::vector<std::vector<double>>& columns) {
+        auto id = SymbolTable::global().lookup(name);
+        const Function* func = id ? functions_->find(*id) : nullptr;
+        if (!func) {
+            throw CalcError("Function not found: " + name);
+        }
+        checkArgumentCount(*func, columns.size());
 
-        if (args.size() != params.size()) {
-            throw CalcError("Function '" + name + "' expects " + std::to_string(params.size()) +
-                            " parameters, but " + std::to_string(args.size()) + " were provided");
+        size_t rows = columns.empty() ? 0 : columns[0].size();
+        for (const auto& column : columns) {
+            if (column.size() != rows) {
+                throw CalcError("Argument columns for '" + name + "' have different lengths");
+            }
         }
+        // A function without parameters still evaluates once
+        if (columns.empty()) rows = 1;
+
+        std::vector<double> results(rows);
+        std::vector<const double*> frame(columns.size());
+        std::vector<double> args(columns.size());
+
+        for (size_t start = 0; start < rows; start += Constants::BATCH_BLOCK) {
+            size_t n = std::min(Constants::BATCH_BLOCK, rows - start);
+            for (size_t p = 0; p < columns.size(); ++p) {
+                frame[p] = columns[p].data() + start;
+            }
+
+            if (executeBatch(func->getProgram(), frame.data(), n, results.data() + start)) continue;
 
-        return evaluateWithLocalScope(func.getBody(), params, args);
+            // Some row in this block fails: evaluate it row by row so the error reported
+            // is the one the first failing row would give
+            for (size_t row = start; row < start + n; ++row) {
+                for (size_t p = 0; p < columns.size(); ++p) {
+                    args[p] = columns[p][row];
+                }
+                results[row] = execute(func->getProgram(), args.data());
+            }
+        }
+
+        return results;
     }
 
-    double Calculator::evaluateWithLocalScope(const std::vector<Token>& body,
-        const std::vector<std::string>& paramNames,
-        const std::vector<double>& paramValues) {
-    if (body.empty()) {
-    throw CalcError("Empty function body");
+    void Calculator::checkArgumentCount(const Function& func, size_t argc) {
+        const auto& params = func.getParameters();
+
+        if (argc != params.size()) {
+            throw CalcError("Function '" + func.getName() + "' expects " + std::to_string(params.size()) +
+                            " parameters, but " + std::to_string(argc) + " were provided");
+        }
     }
 
-    // Save current variables
-    auto savedVariables = variables_;  // Make a copy
+    double Calculator::invokeFunction(SymbolId id, const Function& func, const double* args, size_t argc) {
+        checkArgumentCount(func, argc);
+
+        CallDepthGuard guard(callDepth_, func.getName());
+        CALSCRIPT_PROFILE(&profiler_, id);
+
+        MemoCache* memo = memos_.find(id);
+        if (!memo) {
+            // The arguments themselves are the call frame; parameters were bound to slots at definition time
+            return runBody(func, args);
+        }
+
+        MemoCache::Key key = MemoCache::makeKey(args, argc);
+        if (memo->readsAns()) {
+            key.push_back(MemoCache::makeKey(&lastResult_, 1)[0]);
+        }
+        if (auto cached = memo->find(key, stateEpoch_)) {
+            return *cached;
+        }
 
-    // Create local scope with parameter values
-    for (size_t i = 0; i < paramNames.size(); ++i) {
-    std::string paramName = paramNames[i];
-    variables_[paramName] = paramValues[i];
+        // Errors are not cached; the call is evaluated (and fails) again next time
+        double result = runBody(func, args);
+        memo->insert(std::move(key), result, stateEpoch_);
+        return result;
     }
 
-    // Evaluate the body with the local scope
-    double result;
-    try {
-    result = evaluateExpression(body);
-    } catch (const CalcError& e) {
-    // Restore original variables before rethrowing
-    variables_ = savedVariables;  // Use copy assignment instead of move
-    throw;
-    } catch (...) {
-    // Restore original variables before rethrowing
-    variables_ = savedVariables;  // Use copy assignment instead of move
-    throw CalcError("Unknown error in function evaluation");
+    // Runs a function body, as native code once it has been called JIT_THRESHOLD times
+    double Calculator::runBody(const Function& func, const double* args) {
+        if (jitEnabled_ && func.countCall()) {
+            func.setNativeCode(JitCode::compile(func.getProgram()));
+        }
+        const JitCode* native = func.getNativeCode();
+        if (!native || !jitEnabled_) return execute(func.getProgram(), args);
+
+        JitContext context{lastResult_, 0, this, &jitLoadVariable, &jitCallFunction, nullptr};
+        double result = native->run(args, context);
+        if (!context.failed) return result;
+        if (context.error) std::rethrow_exception(context.error);
+        // Something in the body reports an error; the interpreter reruns it to report it
+        return execute(func.getProgram(), args);
     }
 
-    // Restore original variables
-    variables_ = savedVariables;  // Use copy assignment instead of move
+    // Called from native code, which cannot unwind: failures are flagged in the context instead
+    double Calculator::jitLoadVariable(JitContext* context, uint32_t id) {
+        auto* self = static_cast<Calculator*>(context->calculator);
+        if (const double* variable = self->variables_->find(id)) return *variable;
+        context->failed = 1;
+        return 0;
+    }
 
-    return result;
+    double Calculator::jitCallFunction(JitContext* context, uint32_t id, const double* args, uint32_t argc) {
+        auto* self = static_cast<Calculator*>(context->calculator);
+        const Function* func = self->functions_->find(id);
+        if (!func) {
+            context->failed = 1;
+            return 0;
+        }
+        try {
+            return self->invokeFunction(id, *func, args, argc);
+        } catch (...) {
+            context->error = std::current_exception();
+            context->failed = 1;
+            return 0;
+        }
     }
 
-    void Calculator::handleFunctionDefinition(const std::vector<Token>& tokens) {
-        // This is now handled directly in processInput
-        throw CalcError("Function definition must be in the format: create func name(param1, param2, ...) : body");
+    void Calculator::setJitEnabled(bool enabled) {
+        if (enabled && !JitCode::isAvailable()) {
+            throw CalcError("JIT is not available in this build");
+        }
+        jitEnabled_ = enabled;
     }
 
-    void Calculator::handleFunctionCall(const std::vector<Token>& tokens) {
-        // This is now handled directly in processInput
-        throw CalcError("Function call must be in the format: use func name(arg1, arg2, ...)");
+    void Calculator::setProfiling(bool enabled) {
+#ifdef CALSCRIPT_NO_PROFILE
+        if (enabled) throw CalcError("Profiling is not available in this build");
+#endif
+        if (enabled) {
+            profiler_.start();
+        } else {
+            profiler_.stop();
+        }
     }
 
-    double Calculator::evaluateExpression(const std::vector<Token>& tokens) {
-        if (tokens.empty()) {
-            throw CalcError("Empty expression");
+    void Calculator::enableMemo(const std::string& name, size_t capacity) {
+        auto id = SymbolTable::global().lookup(name);
+        if (!id || !functions_->contains(*id)) {
+            throw CalcError("Function not found: " + name);
         }
 
-        std::stack<double> values;
-        std::stack<std::string> operators;
+        memos_.erase(*id);
+        memos_.insert(*id, MemoCache(capacity));
+        // Callers must call it rather than inline it, or the cache would be bypassed
+        relinkCallers(*id);
+    }
 
-        auto precedence = [](const std::string& op) -> int {
-            if (op == "neg") return 6;
-            if(op == "sin" || op == "cos" || op == "tan" ||
-               op == "log" || op == "ln" || op == "sqrt") return 5;
-            if(op == "!") return 4;
-            if(op == "^") return 3;
-            if(op == "*" || op == "/" || op == "%") return 2;
-            if(op == "+" || op == "-") return 1;
-            return 0;
-        };
+    void Calculator::disableMemo(const std::string& name) {
+        auto id = SymbolTable::global().lookup(name);
+        if (!id || !memos_.erase(*id)) {
+            throw CalcError("Memoization is not enabled for " + name);
+        }
+        relinkCallers(*id);
+    }
 
-        auto applyOperator = [](const std::string& op, double a, double b) -> double {
-            if(op == "+") return a + b;
-            if(op == "-") return a - b;
-            if(op == "*") return a * b;
-            if(op == "/") {
-                if (b == 0) throw CalcError("Division by zero");
-                return a / b;
-            }
-            if(op == "^") return std::pow(a, b);
-            if(op == "%") {
-                if (b == 0) throw CalcError("Modulo by zero");
-                if (std::floor(a) != a || std::floor(b) != b) throw CalcError("Modulo requires integer operands");
-                return std::fmod(a, b);
+    double Calculator::evaluate(std::string_view expression) {
+        Parser::Scope parseScope(parser_);
+        return evaluateExpression(parser_.parseExpression(expression));
+    }
+
+    double Calculator::evaluateExpression(const Expr& expr) {
+        // Constants and folded literals need no program
+        if (expr.kind == Expr::Kind::Number) return expr.value;
+        return run(compile(expr));
+    }
+
+    Program Calculator::compile(const Expr& expr) {
+        CALSCRIPT_PROFILE(&profiler_, Profiler::Phase::Compile);
+        return Compiler::compile(expr);
+    }
+
+    double Calculator::run(const Program& program) {
+        CALSCRIPT_PROFILE(&profiler_, Profiler::Phase::Execute);
+        return execute(program, nullptr);
+    }
+
+    // Replays an expression line seen before without tokenizing or compiling it again
+    bool Calculator::runCachedLine(std::string_view input) {
+        // Whitespace only separates tokens, so runs of it are collapsed and the ends trimmed
+        lineKey_.clear();
+        for (char c : input) {
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                if (!lineKey_.empty() && lineKey_.back() != ' ') lineKey_ += ' ';
+            } else {
+                lineKey_ += c;
             }
-            throw CalcError("Unknown Operator: " + op);
-        };
+        }
+        if (!lineKey_.empty() && lineKey_.back() == ' ') lineKey_.pop_back();
+
+        auto it = lineIndex_.find(lineKey_);
+        if (it == lineIndex_.end()) return false;
+
+        const CachedLine& line = *it->second;
+        bool valid = line.functionEpoch == functionEpoch_;
+        for (const auto& [id, version] : line.variables) {
+            valid = valid && id < variableVersions_.size() && variableVersions_[id] == version;
+        }
+        if (!valid) {
+            lineCache_.erase(it->second);
+            lineIndex_.erase(it);
+            return false;
+        }
+        lineCache_.splice(lineCache_.begin(), lineCache_, it->second);
+
+        // Lines without a stored result read ans
+        if (!line.result && !lastResultKnown_) {
+            skippedForAns_ = true;
+            return true;
+        }
 
-        auto applyUnary = [](const std::string& op, double a) -> double {
-            if (op == "neg") return -a;
-            if(op == "!") {
-                if (a < 0 || std::floor(a) != a) throw CalcError("Factorial requires non-negative integer");
-                double result = 1;
-                for (int i = 2; i <= a; ++i) result *= i;
-                return result;
+        // A stored result is printed without running anything, so the functions the line
+        // calls see no call (memo hits and misses included)
+        double result = line.result ? *line.result : run(line.program);
+        lastResult_ = result;
+        lastResultKnown_ = true;
+        *out_ << "= " << result << '\n';
+        addToHistory(input, result);
+        return true;
+    }
+
+    // Remembers an expression line that evaluated successfully, under the key runCachedLine built
+    void Calculator::cacheLine(Program program, double result) {
+        if (lineKey_.empty()) return;
+        if (auto it = lineIndex_.find(lineKey_); it != lineIndex_.end()) {
+            lineCache_.erase(it->second);
+            lineIndex_.erase(it);
+        }
+        if (lineIndex_.size() >= Constants::LINE_CACHE_CAPACITY) {
+            lineIndex_.erase(lineCache_.back().key);
+            lineCache_.pop_back();
+        }
+
+        std::vector<SymbolId> variables;
+        std::vector<bool> visited;
+        bool readsAns = false;
+        collectDependencies(program, variables, visited, readsAns);
+
+        CachedLine line{lineKey_, std::move(program), {}, functionEpoch_, std::nullopt};
+        std::sort(variables.begin(), variables.end());
+        variables.erase(std::unique(variables.begin(), variables.end()), variables.end());
+        for (SymbolId id : variables) {
+            if (id >= variableVersions_.size()) variableVersions_.resize(id + 1);
+            line.variables.emplace_back(id, variableVersions_[id]);
+        }
+        // Everything else it reads is tracked above; ans changes with every line
+        if (!readsAns) line.result = result;
+
+        lineCache_.push_front(std::move(line));
+        lineIndex_.emplace(lineKey_, lineCache_.begin());
+    }
+
+    // Variables read by program and by every function it calls
+    void Calculator::collectDependencies(const Program& program, std::vector<SymbolId>& variables,
+                                         std::vector<bool>& visited, bool& readsAns) const {
+        for (const auto& ins : program.getCode()) {
+            if (ins.op == OpCode::LoadVar) {
+                variables.push_back(ins.operand);
+            } else if (ins.op == OpCode::LoadAns) {
+                readsAns = true;
+            } else if (ins.op == OpCode::Call) {
+                const Function* func = functions_->find(ins.operand);
+                if (ins.operand >= visited.size()) visited.resize(ins.operand + 1);
+                if (!func || visited[ins.operand]) continue;
+                visited[ins.operand] = true;
+                collectDependencies(func->getProgram(), variables, visited, readsAns);
+                // Inlined callees are already part of the linked program
+                for (SymbolId callee : func->getCallees()) {
+                    if (callee >= visited.size()) visited.resize(callee + 1);
+                    visited[callee] = true;
+                }
             }
-            throw CalcError("Unknown unary operator: " + op);
-        };
+        }
+    }
 
-        // Process tokens
-        for (size_t i = 0; i < tokens.size(); i++) {
-            const auto& token = tokens[i];
-
-            // First, handle function calls
-            if (token.getType() == Token::Type::Variable &&
-                i + 1 < tokens.size() &&
-                tokens[i+1].getType() == Token::Type::Bracket &&
-                tokens[i+1].getValue() == "(") {
-
-                std::string funcName = token.getValue();
-
-                if (functionExists(funcName)) {
-
-                    // Find the matching closing parenthesis
-                    int parenCount = 1;
-                    size_t j = i + 2;  // Skip the variable token and opening parenthesis
-                    size_t argStart = j;
-                    std::vector<std::vector<Token>> argTokens;
-
-                    while (j < tokens.size() && parenCount > 0) {
-                        if (tokens[j].getType() == Token::Type::Bracket) {
-                            if (tokens[j].getValue() == "(") {
-                                parenCount++;
-                            } else if (tokens[j].getValue() == ")") {
-                                parenCount--;
-
-                                if (parenCount == 0) {
-                                    // End of function call, add the last argument if there's one
-                                    if (j > argStart) {
-                                        std::vector<Token> arg(tokens.begin() + argStart, tokens.begin() + j);
-                                        if (!arg.empty()) {
-                                            argTokens.push_back(arg);
-                                        }
-                                    }
-                                }
-                            }
-                        } else if (tokens[j].getType() == Token::Type::Comma && parenCount == 1) {
-                            std::vector<Token> arg(tokens.begin() + argStart, tokens.begin() + j);
-                            if (!arg.empty()) {
-                                argTokens.push_back(arg);
-                            }
-                            argStart = j + 1;  // Start of next argument
-                        }
-                        j++;
-                    }
+    double Calculator::execute(const Program& program, const double* frame) {
+        // Locals (arguments of inlined calls) live after the value stack
+        SmallStack<double, Constants::INLINE_STACK> values(program.getMaxDepth() + program.getLocalCount());
+        double* locals = values.data() + program.getMaxDepth();
+        size_t sp = 0;
 
-                    if (parenCount > 0) {
-                        throw CalcError("Unclosed parenthesis in function call to " + funcName);
-                    }
+        for (const auto& ins : program.getCode()) {
+            switch (ins.op) {
+                case OpCode::PushConst:
+                    values[sp++] = ins.value;
+                    break;
 
-                    // Evaluate each argument
-                    std::vector<double> argValues;
-                    for (const auto& arg : argTokens) {
-                        try {
-                            argValues.push_back(evaluateExpression(arg));
-                        } catch (const CalcError& e) {
-                            // Improve error messages for nested function calls
-                            std::string errorMsg = e.what();
-                            throw CalcError("In argument to " + funcName + "(): " + errorMsg);
+                case OpCode::LoadVar: {
+                    const double* variable = variables_->find(ins.operand);
+                    if (!variable) {
+                        const std::string& varName = SymbolTable::global().name(ins.operand);
+                        // Also check if it's a function (which would be invalid without parentheses)
+                        if (functionExists(ins.operand)) {
+                            throw CalcError("Function '" + varName + "' used without parentheses. Did you mean '" + varName + "(...)'?");
                         }
+                        throw CalcError("Undefined variable: " + varName);
                     }
+                    values[sp++] = *variable;
+                    break;
+                }
+
+                case OpCode::LoadParam:
+                    values[sp++] = frame[ins.operand];
+                    break;
+
+                case OpCode::LoadAns:
+                    values[sp++] = lastResult_;
+                    break;
 
-                    // Call the function and push the result
-                    double result = callFunction(funcName, argValues);
-                    values.push(result);
+                case OpCode::StoreLocal:
+                    locals[ins.operand] = values[--sp];
+                    break;
+
+                case OpCode::LoadLocal:
+                    values[sp++] = locals[ins.operand];
+                    break;
+
+                case OpCode::Add:
+                    --sp;
+                    values[sp-1] = values[sp-1] + values[sp];
+                    break;
+
+                case OpCode::Sub:
+                    --sp;
+                    values[sp-1] = values[sp-1] - values[sp];
+                    break;
+
+                case OpCode::Mul:
+                    --sp;
+                    values[sp-1] = values[sp-1] * values[sp];
+                    break;
+
+                case OpCode::Div:
+                    --sp;
+                    values[sp-1] = Operations::divide(values[sp-1], values[sp]);
+                    break;
+
+                case OpCode::Mod:
+                    --sp;
+                    values[sp-1] = Operations::modulo(values[sp-1], values[sp]);
+                    break;
+
+                case OpCode::Pow:
+                    --sp;
+                    values[sp-1] = std::pow(values[sp-1], values[sp]);
+                    break;
+
+                case OpCode::Neg:
+                    values[sp-1] = -values[sp-1];
+                    break;
+
+                case OpCode::Square:
+                    values[sp-1] = values[sp-1] * values[sp-1];
+                    break;
+
+                case OpCode::PowHalf:
+                    values[sp-1] = Operations::powHalf(values[sp-1]);
+                    break;
+
+                case OpCode::Factorial:
+                    values[sp-1] = Operations::factorial(values[sp-1]);
+                    break;
+
+                case OpCode::Sin:
+                case OpCode::Cos:
+                case OpCode::Tan:
+                case OpCode::Log:
+                case OpCode::Ln:
+                case OpCode::Sqrt:
+                    values[sp-1] = Operations::mathFunction(ins.op, values[sp-1]);
+                    break;
 
-                    // Skip over the processed tokens
-                    i = j - 1;  // -1 because the loop will increment i
-                    continue;
+                case OpCode::Call: {
+                    const Function* func = functions_->find(ins.operand);
+                    if (!func) {
+                        throw CalcError("Function not found: " + SymbolTable::global().name(ins.operand));
+                    }
+                    // Arguments are already contiguous on the value stack and serve as the callee's frame
+                    sp -= ins.argc;
+                    values[sp] = invokeFunction(ins.operand, *func, values.data() + sp, ins.argc);
+                    sp++;
+                    break;
                 }
             }
+        }
 
-            switch(token.getType()) {
-                case Token::Type::Number: {
-                    values.push(std::stod(token.getValue()));
+        // Compiled programs leave exactly their value
+        if (sp != 1) throw CalcError("Malformed program");
+        return values[0];
+    }
+
+    bool Calculator::executeBatch(const Program& program, const double* const* frame, size_t n, double* out) {
+        // Structure of arrays: stack slot s holds one value per row, so every instruction
+        // is a plain loop over contiguous doubles that the compiler can vectorize
+        constexpr size_t W = Constants::BATCH_BLOCK;
+        size_t depth = std::max<size_t>(program.getMaxDepth(), 1);
+        // Slots come from the calculator's arena, so steady batch work stops allocating
+        MemoryPool<double>::Scope stackScope(batchStack_);
+        double* stack = batchStack_.allocateArray((depth + program.getLocalCount()) * W);
+        size_t sp = 0;
+        auto slot = [&](size_t s) { return stack + s * W; };
+        auto local = [&](size_t l) { return stack + (depth + l) * W; };
+
+        for (const auto& ins : program.getCode()) {
+            switch (ins.op) {
+                case OpCode::PushConst:
+                    std::fill_n(slot(sp++), n, ins.value);
+                    break;
+
+                case OpCode::LoadVar: {
+                    const double* variable = variables_->find(ins.operand);
+                    if (!variable) {
+                        // Same for every row, so report it exactly as execute would
+                        const std::string& varName = SymbolTable::global().name(ins.operand);
+                        if (functionExists(ins.operand)) {
+                            throw CalcError("Function '" + varName + "' used without parentheses. Did you mean '" + varName + "(...)'?");
+                        }
+                        throw CalcError("Undefined variable: " + varName);
+                    }
+                    std::fill_n(slot(sp++), n, *variable);
                     break;
                 }
 
-                case Token::Type::PrevResult: {
-                    values.push(lastResult_);
+                case OpCode::LoadParam:
+                    std::copy_n(frame[ins.operand], n, slot(sp++));
+                    break;
+
+                case OpCode::LoadAns:
+                    std::fill_n(slot(sp++), n, lastResult_);
+                    break;
+
+                case OpCode::StoreLocal:
+                    std::copy_n(slot(--sp), n, local(ins.operand));
+                    break;
+
+                case OpCode::LoadLocal:
+                    std::copy_n(local(ins.operand), n, slot(sp++));
+                    break;
+
+                case OpCode::Add: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    for (size_t i = 0; i < n; ++i) a[i] = a[i] + b[i];
                     break;
                 }
 
-                case Token::Type::MathFunction: {
-                    operators.push(token.getValue());
+                case OpCode::Sub: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    for (size_t i = 0; i < n; ++i) a[i] = a[i] - b[i];
                     break;
                 }
 
-                case Token::Type::Variable: {
-                    std::string varName = token.getValue();
+                case OpCode::Mul: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    for (size_t i = 0; i < n; ++i) a[i] = a[i] * b[i];
+                    break;
+                }
 
-                    // Check if this might be a function call with parentheses
-                    if (i + 1 < tokens.size() &&
-                        tokens[i+1].getType() == Token::Type::Bracket &&
-                        tokens[i+1].getValue() == "(") {
+                case OpCode::Div: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    bool defined = true;
+                    for (size_t i = 0; i < n; ++i) defined &= Operations::isDefined(OpCode::Div, a[i], b[i]);
+                    if (!defined) return false;
+                    for (size_t i = 0; i < n; ++i) a[i] = a[i] / b[i];
+                    break;
+                }
 
-                        // Skip this - function calls are now handled at the beginning of the loop
-                        // The function detection code at the top of the method will handle it
-                        break;
+                case OpCode::Mod: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    for (size_t i = 0; i < n; ++i) {
+                        if (!Operations::isDefined(OpCode::Mod, a[i], b[i])) return false;
                     }
+                    for (size_t i = 0; i < n; ++i) a[i] = Operations::modulo(a[i], b[i]);
+                    break;
+                }
 
-                    // Not a function call - check if it's a constant first
-                    if (varName == "pi") {
-                        values.push(Constants::PI);
-                    } else if (varName == "e") {
-                        values.push(Constants::E);
-                    } else if (varName == "phi") {
-                        values.push(Constants::PHI);
-                    } else if (varName == "sqrt2") {
-                        values.push(Constants::SQRT2);
-                    } else if (varName == "ans") {
-                        values.push(lastResult_);
-                    } else {
-                        // Then check if it's a variable
-                        auto it = variables_.find(varName);
-                        if (it == variables_.end()) {
-                            // Also check if it's a function (which would be invalid without parentheses)
-                            if (functionExists(varName)) {
-                                throw CalcError("Function '" + varName + "' used without parentheses. Did you mean '" + varName + "(...)'?");
-                            }
-                            throw CalcError("Undefined variable: " + varName);
-                        }
-                        values.push(it->second);
-                    }
+                case OpCode::Pow: {
+                    --sp;
+                    double* a = slot(sp - 1);
+                    const double* b = slot(sp);
+                    for (size_t i = 0; i < n; ++i) a[i] = std::pow(a[i], b[i]);
                     break;
                 }
 
-                case Token::Type::Boolean: {
-                    if (token.getValue() == "true") {
-                        values.push(1.0);
-                    } else if (token.getValue() == "false") {
-                        values.push(0.0);
-                    } else {
-                        throw CalcError("Invalid boolean value: " + token.getValue());
-                    }
+                case OpCode::Neg: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) a[i] = -a[i];
                     break;
                 }
 
-                case Token::Type::Constant: {
-                    if(token.getValue() == "pi") values.push(Constants::PI);
-                    else if(token.getValue() == "e") values.push(Constants::E);
-                    else if(token.getValue() == "phi") values.push(Constants::PHI);
-                    else if(token.getValue() == "sqrt2") values.push(Constants::SQRT2);
-                    else throw CalcError("Unknown constant: " + token.getValue());
+                case OpCode::Square: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) a[i] = a[i] * a[i];
                     break;
                 }
 
-                case Token::Type::Operator: {
-                    const auto& op = token.getValue();
-
-                    while(!operators.empty() && operators.top() != "(" &&
-                          (precedence(operators.top()) > precedence(op) ||
-                           (precedence(operators.top()) == precedence(op) && op != "^"))) {
-                        const auto& curr_op = operators.top();
-                        operators.pop();
-
-                        if (curr_op == "!") {
-                            if (values.empty()) throw CalcError("Invalid expression");
-                            double val = values.top();
-                            values.pop();
-                            values.push(applyUnary(curr_op, val));
-                        } else if (isMathFunction(curr_op)) {
-                            if (values.empty()) throw CalcError("Function requires an argument");
-                            double arg = values.top();
-                            values.pop();
-                            values.push(evaluateMathFunction(curr_op, arg));
-                        } else if (curr_op == "neg") {
-                            if (values.empty()) throw CalcError("Invalid expression");
-                            double val = values.top();
-                            values.pop();
-                            values.push(applyUnary(curr_op, val));
-                        } else {
-                            if(values.size() < 2) throw CalcError("Invalid expression");
-                            double b = values.top(); values.pop();
-                            double a = values.top(); values.pop();
-                            values.push(applyOperator(curr_op, a, b));
-                        }
-                           }
-                    operators.push(op);
+                case OpCode::PowHalf: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) a[i] = Operations::powHalf(a[i]);
                     break;
                 }
 
-                case Token::Type::Bracket: {
-                    if(token.getValue() == "(") {
-                        operators.push("(");
-                    } else {
-                        bool hadMathFunction = false;
-
-                        while(!operators.empty() && operators.top() != "(") {
-                            const auto& op = operators.top();
-                            operators.pop();
-
-                            if(isMathFunction(op)) {
-                                if (values.empty()) throw CalcError("Function requires an argument");
-                                double arg = values.top();
-                                values.pop();
-                                values.push(evaluateMathFunction(op, arg));
-                                hadMathFunction = true;
-                            }
-                            else if(op == "!") {
-                                if (values.empty()) throw CalcError("Invalid Expression");
-                                double val = values.top();
-                                values.pop();
-                                values.push(applyUnary(op, val));
-                            } else if (op == "neg") {
-                                if (values.empty()) throw CalcError("Invalid Expression");
-                                double val = values.top();
-                                values.pop();
-                                values.push(applyUnary(op, val));
-                            } else {
-                                if (values.size() < 2) throw CalcError("Invalid Expression");
-                                double b = values.top(); values.pop();
-                                double a = values.top(); values.pop();
-                                values.push(applyOperator(op, a, b));
-                            }
-                        }
+                case OpCode::Factorial: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) {
+                        if (!Operations::isDefined(OpCode::Factorial, a[i])) return false;
+                    }
+                    for (size_t i = 0; i < n; ++i) a[i] = Operations::factorial(a[i]);
+                    break;
+                }
 
-                        if(operators.empty()) throw CalcError("Mismatched parenthesis");
-                        operators.pop(); // remove opening bracket
+                case OpCode::Sqrt: {
+                    double* a = slot(sp - 1);
+                    bool defined = true;
+                    for (size_t i = 0; i < n; ++i) defined &= Operations::isDefined(OpCode::Sqrt, a[i]);
+                    if (!defined) return false;
+                    // Operations::mathFunction's sqrt once the domain is checked, inline so it vectorizes
+                    for (size_t i = 0; i < n; ++i) a[i] = std::sqrt(a[i]);
+                    break;
+                }
+
+                case OpCode::Tan: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) {
+                        if (!Operations::isDefined(OpCode::Tan, a[i])) return false;
                     }
+                    for (size_t i = 0; i < n; ++i) a[i] = Operations::mathFunction(ins.op, a[i]);
+                    break;
+                }
+
+                case OpCode::Sin:
+                case OpCode::Cos:
+                case OpCode::Log:
+                case OpCode::Ln: {
+                    double* a = slot(sp - 1);
+                    for (size_t i = 0; i < n; ++i) a[i] = Operations::mathFunction(ins.op, a[i]);
                     break;
                 }
 
-                case Token::Type::Comma:
-                case Token::Type::Colon:
-                case Token::Type::Command:
-                    throw CalcError("Unexpected token in expression: " + token.getValue());
+                case OpCode::Call: {
+                    const Function* func = functions_->find(ins.operand);
+                    if (!func) {
+                        throw CalcError("Function not found: " + SymbolTable::global().name(ins.operand));
+                    }
+                    checkArgumentCount(*func, ins.argc);
+                    CallDepthGuard guard(callDepth_, func->getName());
+
+                    // The argument slots become the callee's frame columns
+                    sp -= ins.argc;
+                    SmallStack<const double*, Constants::INLINE_STACK> args(ins.argc);
+                    for (size_t p = 0; p < ins.argc; ++p) {
+                        args[p] = slot(sp + p);
+                    }
+                    if (!executeBatch(func->getProgram(), args.data(), n, slot(sp))) return false;
+                    sp++;
                     break;
+                }
             }
         }
 
-        while(!operators.empty()) {
-            const auto& op = operators.top();
-            operators.pop();
+        std::copy_n(slot(0), n, out);
+        return true;
+    }
 
-            if(op == "(") throw CalcError("Mismatched parenthesis");
+    bool Calculator::isIndependent(std::string_view input) {
+        // Only the keyword is looked at: expressions are parsed where they run
+        try {
+            Statement::Kind kind = parser_.parseStatement(input).kind;
+            // Commands change state (or print it)
+            return kind == Statement::Kind::Empty || kind == Statement::Kind::Expression;
+        } catch (const CalcError&) {
+            return true;  // fails the same way wherever it runs
+        }
+    }
 
-            if(isMathFunction(op)) {
-                if (values.empty()) throw CalcError("Function requires an argument");
-                double arg = values.top();
-                values.pop();
-                values.push(evaluateMathFunction(op, arg));
-            }
-            else if(op == "!") {
-                if (values.empty()) throw CalcError("Invalid Expression");
-                double val = values.top();
-                values.pop();
-                values.push(applyUnary(op, val));
-            } else if (op == "neg") {
-                if (values.empty()) throw CalcError("Invalid Expression");
-                double val = values.top();
-                values.pop();
-                values.push(applyUnary(op, val));
-            } else {
-                if(values.size() < 2) throw CalcError("Invalid expression");
-                double b = values.top(); values.pop();
-                double a = values.top(); values.pop();
-                values.push(applyOperator(op, a, b));
-            }
+    // True if calling func can read ans, directly or through the functions it calls
+    bool Calculator::readsPreviousResult(SymbolId func, std::vector<bool>& visited) const {
+        const Function* function = functions_->find(func);
+        if (!function) return false;
+
+        if (func >= visited.size()) visited.resize(func + 1);
+        if (visited[func]) return false;  // already being checked further up
+        visited[func] = true;
+        return readsPreviousResult(function->getProgram(), visited);
+    }
+
+    bool Calculator::readsPreviousResult(const Program& program, std::vector<bool>& visited) const {
+        for (const auto& instr : program.getCode()) {
+            if (instr.op == OpCode::LoadAns) return true;
+            if (instr.op == OpCode::Call && readsPreviousResult(instr.operand, visited)) return true;
         }
+        return false;
+    }
 
-        if(values.empty()) throw CalcError("Empty expression");
-        if(values.size() > 1) throw CalcError("Invalid expression");
-        return values.top();
+    void Calculator::copyStateFrom(const Calculator& other) {
+        variables_ = other.variables_;
+        functions_ = other.functions_;
+        memos_ = other.memos_;
+        formulas_ = other.formulas_;
+        dependents_ = other.dependents_;
+        lastResult_ = other.lastResult_;
+        lastResultKnown_ = other.lastResultKnown_;
+        stateEpoch_++;
+        lineCache_.clear();
+        lineIndex_.clear();
     }
 }
\ No newline at end of file
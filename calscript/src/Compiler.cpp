@@ -0,0 +1,112 @@
+#include "Compiler.hpp"
+#include "Constants.hpp"
+#include "SmallStack.hpp"
+#include <string>
+
+namespace calc {
+    namespace {
+        // Opcode emitted for each operator, indexed by Operator
+        constexpr size_t OPERATOR_COUNT = static_cast<size_t>(Operator::Count);
+
+        constexpr OpCode OPCODE[OPERATOR_COUNT] = {
+            OpCode::PushConst,  // unused
+            OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Mod, OpCode::Pow,
+            OpCode::Factorial, OpCode::Neg,
+            OpCode::Sin, OpCode::Cos, OpCode::Tan, OpCode::Log, OpCode::Ln, OpCode::Sqrt,
+            OpCode::PushConst, OpCode::PushConst  // unused
+        };
+
+        constexpr size_t index(Operator op) { return static_cast<size_t>(op); }
+
+        // Emits instructions for a tree in postfix order while tracking the value stack depth
+        class Emitter {
+            public:
+                Emitter(const std::vector<std::string>& params, Program& program)
+                    : params_(params), program_(program) {}
+
+                void emit(const Expr& root);
+                size_t getMaxDepth() const { return maxDepth_; }
+
+            private:
+                const std::vector<std::string>& params_;
+                Program& program_;
+                size_t depth_{0};
+                size_t maxDepth_{0};
+
+                void push() {
+                    if (++depth_ > maxDepth_) maxDepth_ = depth_;
+                }
+
+                void emitOperand(const Expr& expr);
+        };
+
+        void Emitter::emit(const Expr& root) {
+            // Left operands are followed in a loop, so long chains like a+b+c+... do not recurse
+            // once per term; right operands and arguments recurse, bounded by the parser's nesting limit
+            SmallStack<const Expr*, Constants::INLINE_STACK> pending;
+            const Expr* expr = &root;
+            while (expr->kind == Expr::Kind::Unary || expr->kind == Expr::Kind::Binary) {
+                pending.push_back(expr);
+                expr = expr->lhs;
+            }
+            emitOperand(*expr);
+
+            while (!pending.empty()) {
+                const Expr* op = pending.back();
+                pending.pop_back();
+                if (op->kind == Expr::Kind::Binary) {
+                    emit(*op->rhs);
+                    depth_--;
+                }
+                program_.emit(OPCODE[index(op->op)]);
+            }
+        }
+
+        void Emitter::emitOperand(const Expr& expr) {
+            switch (expr.kind) {
+                case Expr::Kind::Number:
+                    program_.emit(OpCode::PushConst, expr.value);
+                    push();
+                    break;
+
+                case Expr::Kind::Ans:
+                    program_.emit(OpCode::LoadAns);
+                    push();
+                    break;
+
+                case Expr::Kind::Variable:
+                    for (size_t slot = 0; slot < params_.size(); ++slot) {
+                        if (params_[slot] == expr.name) {
+                            program_.emitSlot(OpCode::LoadParam, static_cast<uint32_t>(slot));
+                            push();
+                            return;
+                        }
+                    }
+                    program_.emitSymbol(OpCode::LoadVar, expr.symbol);
+                    push();
+                    break;
+
+                case Expr::Kind::Call:
+                    // Arguments are left on the stack in order and become the callee's frame
+                    for (const Expr* arg = expr.lhs; arg; arg = arg->next) emit(*arg);
+                    program_.emitSymbol(OpCode::Call, expr.symbol, expr.argc);
+                    depth_ -= expr.argc;
+                    push();
+                    break;
+
+                case Expr::Kind::Unary:
+                case Expr::Kind::Binary:
+                    emit(expr);
+                    break;
+            }
+        }
+    }
+
+    Program Compiler::compile(const Expr& expr, const std::vector<std::string>& params) {
+        Program program;
+        Emitter emitter(params, program);
+        emitter.emit(expr);
+        program.setMaxDepth(emitter.getMaxDepth());
+        return program;
+    }
+}
\ No newline at end of file
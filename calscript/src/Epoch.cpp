@@ -0,0 +1,74 @@
+#include "Epoch.hpp"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace calc {
+    EpochDomain::Reader::Reader(EpochDomain& domain) : domain_(domain), slot_(domain.claim()) {}
+
+    EpochDomain::Reader::~Reader() {
+        slot_->epoch.store(0, std::memory_order_release);
+        slot_->claimed.store(false, std::memory_order_release);
+    }
+
+    EpochDomain::Guard::Guard(Reader& reader) : reader_(reader) {
+        if (reader_.depth_++ > 0) return;
+
+        Slot& slot = *reader_.slot_;
+        slot.epoch.store(reader_.domain_.epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        // Pairs with the fence in retire: either the writer sees this slot, or the reads
+        // that follow see the writer's update and never reach the retired object
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    EpochDomain::Guard::~Guard() {
+        if (--reader_.depth_ > 0) return;
+        reader_.slot_->epoch.store(0, std::memory_order_release);
+    }
+
+    EpochDomain::Slot* EpochDomain::claim() {
+        for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+            bool idle = false;
+            if (slot->claimed.compare_exchange_strong(idle, true, std::memory_order_acquire)) return slot;
+        }
+
+        auto* slot = new Slot;
+        slot->next = slots_.load(std::memory_order_relaxed);
+        while (!slots_.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {}
+        return slot;
+    }
+
+    void EpochDomain::retire(std::function<void()> free) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Readers that entered before this point may hold the object; later ones cannot
+        uint64_t epoch = epoch_.fetch_add(1, std::memory_order_acq_rel);
+
+        std::vector<Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(retiredMutex_);
+            retired_.push_back({epoch, std::move(free)});
+
+            uint64_t oldest = std::numeric_limits<uint64_t>::max();
+            for (Slot* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next) {
+                uint64_t entered = slot->epoch.load(std::memory_order_acquire);
+                if (entered != 0) oldest = std::min(oldest, entered);
+            }
+
+            auto safe = std::stable_partition(retired_.begin(), retired_.end(),
+                                              [oldest](const Retired& r) { return r.epoch < oldest; });
+            std::move(retired_.begin(), safe, std::back_inserter(ready));
+            retired_.erase(retired_.begin(), safe);
+        }
+        // Outside the lock: freeing may retire more
+        for (auto& r : ready) r.free();
+    }
+
+    EpochDomain::~EpochDomain() {
+        for (auto& r : retired_) r.free();
+        for (Slot* slot = slots_.load(std::memory_order_relaxed); slot;) {
+            Slot* next = slot->next;
+            delete slot;
+            slot = next;
+        }
+    }
+}
\ No newline at end of file
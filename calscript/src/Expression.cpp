@@ -0,0 +1,150 @@
+#include "Expression.hpp"
+#include "Compiler.hpp"
+#include "Constants.hpp"
+#include "Operations.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "SmallStack.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace calc {
+    Expression Expression::compile(std::string_view source, const std::vector<std::string>& variables) {
+        for (size_t i = 0; i < variables.size(); ++i) {
+            if (std::find(variables.begin(), variables.begin() + i, variables[i]) != variables.begin() + i) {
+                throw CalcError("Duplicate variable name: " + variables[i]);
+            }
+        }
+
+        auto code = std::make_shared<Code>();
+        code->source = std::string(source);
+        code->variables = variables;
+
+        // Names are looked up, not interned, so compiling expressions never grows the
+        // process-wide symbol table; names are case-insensitive, so the text is parsed lowercased
+        std::string text(source);
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        Parser parser;
+        const Expr& tree = parser.parseExpression(text);
+
+        // Every name that is not listed becomes a variable after the listed ones, in the order
+        // the names are first read (left to right)
+        std::vector<const Expr*> pending{&tree};
+        while (!pending.empty()) {
+            const Expr* expr = pending.back();
+            pending.pop_back();
+            if (expr->kind == Expr::Kind::Variable &&
+                std::find(code->variables.begin(), code->variables.end(), expr->name) == code->variables.end()) {
+                code->variables.emplace_back(expr->name);
+            }
+            if (expr->next) pending.push_back(expr->next);
+            if (expr->rhs) pending.push_back(expr->rhs);
+            if (expr->lhs) pending.push_back(expr->lhs);
+        }
+
+        Program program = Compiler::compile(tree, code->variables);
+        for (const Instruction& ins : program.getCode()) {
+            if (ins.op == OpCode::LoadAns) {
+                throw CalcError("ans is not available outside a calculator");
+            }
+        }
+
+        code->program = Optimizer::optimize(program);
+        code->native = JitCode::compile(code->program);
+        return Expression(std::move(code));
+    }
+
+    int Expression::slot(std::string_view name) const {
+        const auto& variables = code_->variables;
+        auto it = std::find(variables.begin(), variables.end(), name);
+        return it == variables.end() ? -1 : static_cast<int>(it - variables.begin());
+    }
+
+    double Expression::eval(const double* values) const {
+        if (code_->native) {
+            // No callbacks: the program has no globals or calls for native code to ask for
+            JitContext context{0.0, 0, nullptr, nullptr, nullptr, nullptr};
+            double result = code_->native->run(values, context);
+            if (!context.failed) return result;
+            // Native code stops at anything that reports an error; the interpreter reports it
+        }
+        return interpret(code_->program, values);
+    }
+
+    double Expression::eval(const std::vector<double>& values) const {
+        checkCount(values.size());
+        return eval(values.data());
+    }
+
+    double Expression::eval(std::initializer_list<double> values) const {
+        checkCount(values.size());
+        return eval(values.begin());
+    }
+
+    void Expression::checkCount(size_t count) const {
+        if (count != code_->variables.size()) {
+            throw CalcError("Expression expects " + std::to_string(code_->variables.size()) + " values, but " +
+                            std::to_string(count) + " were provided");
+        }
+    }
+
+    double Expression::eval(const Bindings& bindings) const {
+        const auto& variables = code_->variables;
+        SmallStack<double, Constants::INLINE_STACK> values(variables.size());
+        for (size_t i = 0; i < variables.size(); ++i) {
+            auto it = bindings.find(variables[i]);
+            if (it == bindings.end()) throw CalcError("Undefined variable: " + variables[i]);
+            values[i] = it->second;
+        }
+        return eval(values.data());
+    }
+
+    // The instructions a standalone expression can contain, with the meaning Operations gives
+    // them in Calculator::execute too
+    double Expression::interpret(const Program& program, const double* values) {
+        SmallStack<double, Constants::INLINE_STACK> stack(program.getMaxDepth());
+        size_t sp = 0;
+
+        for (const auto& ins : program.getCode()) {
+            switch (ins.op) {
+                case OpCode::PushConst:
+                    stack[sp++] = ins.value;
+                    break;
+
+                case OpCode::LoadParam:
+                    stack[sp++] = values[ins.operand];
+                    break;
+
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mul:
+                case OpCode::Div:
+                case OpCode::Mod:
+                case OpCode::Pow:
+                    --sp;
+                    stack[sp-1] = Operations::apply(ins.op, stack[sp-1], stack[sp]);
+                    break;
+
+                case OpCode::Neg:
+                case OpCode::Square:
+                case OpCode::PowHalf:
+                case OpCode::Factorial:
+                case OpCode::Sin:
+                case OpCode::Cos:
+                case OpCode::Tan:
+                case OpCode::Log:
+                case OpCode::Ln:
+                case OpCode::Sqrt:
+                    stack[sp-1] = Operations::apply(ins.op, stack[sp-1]);
+                    break;
+
+                default:
+                    throw CalcError("Instruction not supported in a standalone expression");
+            }
+        }
+
+        // A compiled expression leaves exactly its value
+        if (sp != 1) throw CalcError("Malformed expression program");
+        return stack[0];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "FunctionImage.hpp"
+#include "Token.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+namespace calc {
+    namespace {
+        static_assert(sizeof(image::Header) == 48, "image header layout changed");
+        static_assert(sizeof(image::FunctionEntry) == 40, "image function layout changed");
+        static_assert(sizeof(image::VariableEntry) == 16, "image variable layout changed");
+        static_assert(sizeof(image::FormulaEntry) == 12, "image formula layout changed");
+        static_assert(sizeof(Instruction) == 16, "image instruction layout changed");
+
+        constexpr uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+        // Byte offset of each section, derived from the counts in the header
+        struct Layout {
+            uint64_t symbols, functions, params, variables, formulas, code, text, end;
+
+            explicit Layout(const image::Header& header) {
+                uint64_t position = align8(sizeof(image::Header));
+                auto section = [&position](uint64_t bytes) {
+                    uint64_t start = position;
+                    position = align8(position + bytes);
+                    return start;
+                };
+                symbols = section(uint64_t(header.symbolCount) * sizeof(image::TextRef));
+                functions = section(uint64_t(header.functionCount) * sizeof(image::FunctionEntry));
+                params = section(uint64_t(header.paramCount) * sizeof(uint32_t));
+                variables = section(uint64_t(header.variableCount) * sizeof(image::VariableEntry));
+                formulas = section(uint64_t(header.formulaCount) * sizeof(image::FormulaEntry));
+                code = section(uint64_t(header.instructionCount) * sizeof(Instruction));
+                text = section(header.textSize);
+                end = position;
+            }
+        };
+
+        bool isIdentifier(std::string_view name) {
+            if (name.empty() || !std::isalpha(static_cast<unsigned char>(name.front()))) return false;
+            return std::all_of(name.begin(), name.end(), [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            });
+        }
+
+        // Fields are copied one at a time so the padding after Instruction::op is written as zeros
+        void storeInstruction(char* out, const Instruction& ins) {
+            std::memcpy(out + offsetof(Instruction, op), &ins.op, sizeof ins.op);
+            std::memcpy(out + offsetof(Instruction, argc), &ins.argc, sizeof ins.argc);
+            std::memcpy(out + offsetof(Instruction, operand), &ins.operand, sizeof ins.operand);
+            std::memcpy(out + offsetof(Instruction, value), &ins.value, sizeof ins.value);
+        }
+    }
+
+    uint32_t FunctionImageWriter::symbol(SymbolId id) {
+        auto [it, added] = symbolIndex_.emplace(id, static_cast<uint32_t>(symbols_.size()));
+        if (added) symbols_.push_back(text(SymbolTable::global().name(id)));
+        return it->second;
+    }
+
+    image::TextRef FunctionImageWriter::text(std::string_view s) {
+        image::TextRef ref{static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(s.size())};
+        text_.append(s);
+        return ref;
+    }
+
+    void FunctionImageWriter::addFunction(SymbolId name, const std::vector<std::string>& params, std::string_view body,
+                                          const Program& program) {
+        image::FunctionEntry entry{};
+        entry.name = symbol(name);
+        entry.firstParam = static_cast<uint32_t>(params_.size());
+        entry.paramCount = static_cast<uint32_t>(params.size());
+        for (const auto& param : params) {
+            params_.push_back(symbol(SymbolTable::global().intern(param)));
+        }
+
+        entry.firstInstruction = static_cast<uint32_t>(code_.size());
+        entry.instructionCount = static_cast<uint32_t>(program.getCode().size());
+        for (Instruction ins : program.getCode()) {
+            if (ins.op == OpCode::LoadVar || ins.op == OpCode::Call) ins.operand = symbol(ins.operand);
+            code_.push_back(ins);
+        }
+        entry.maxDepth = static_cast<uint32_t>(program.getMaxDepth());
+        entry.localCount = static_cast<uint32_t>(program.getLocalCount());
+        entry.body = text(body);
+        functions_.push_back(entry);
+    }
+
+    void FunctionImageWriter::addVariable(SymbolId name, double value) {
+        variables_.push_back({symbol(name), 0, value});
+    }
+
+    void FunctionImageWriter::addFormula(SymbolId name, std::string_view expression) {
+        formulas_.push_back({symbol(name), text(expression)});
+    }
+
+    void FunctionImageWriter::write(const std::string& path) const {
+        if (text_.size() > UINT32_MAX || code_.size() > UINT32_MAX) {
+            throw CalcError("Too much to save in one image");
+        }
+
+        image::Header header{};
+        std::memcpy(header.magic, image::MAGIC, sizeof header.magic);
+        header.version = image::VERSION;
+        header.byteOrder = image::BYTE_ORDER_MARK;
+        header.instructionSize = sizeof(Instruction);
+        header.symbolCount = static_cast<uint32_t>(symbols_.size());
+        header.functionCount = static_cast<uint32_t>(functions_.size());
+        header.paramCount = static_cast<uint32_t>(params_.size());
+        header.variableCount = static_cast<uint32_t>(variables_.size());
+        header.formulaCount = static_cast<uint32_t>(formulas_.size());
+        header.instructionCount = static_cast<uint32_t>(code_.size());
+        header.textSize = static_cast<uint32_t>(text_.size());
+
+        // The whole image is assembled in memory (zero padded) and written at once
+        Layout layout(header);
+        std::string out(layout.end, '\0');
+        auto put = [&out](uint64_t offset, const void* data, size_t bytes) {
+            if (bytes > 0) std::memcpy(&out[offset], data, bytes);
+        };
+        put(0, &header, sizeof header);
+        put(layout.symbols, symbols_.data(), symbols_.size() * sizeof(image::TextRef));
+        put(layout.functions, functions_.data(), functions_.size() * sizeof(image::FunctionEntry));
+        put(layout.params, params_.data(), params_.size() * sizeof(uint32_t));
+        put(layout.variables, variables_.data(), variables_.size() * sizeof(image::VariableEntry));
+        put(layout.formulas, formulas_.data(), formulas_.size() * sizeof(image::FormulaEntry));
+        for (size_t i = 0; i < code_.size(); ++i) {
+            storeInstruction(&out[layout.code + i * sizeof(Instruction)], code_[i]);
+        }
+        put(layout.text, text_.data(), text_.size());
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size())) || !file.flush()) {
+            throw CalcError("Cannot write " + path);
+        }
+    }
+
+    FunctionImage::FunctionImage(const std::string& path) : file_(path) {
+        std::string_view data = file_.getContents();
+        auto corrupt = [&path](const std::string& what) {
+            return CalcError("Corrupt image " + path + ": " + what);
+        };
+
+        image::Header header;
+        if (data.size() < sizeof header) {
+            throw CalcError("Not a calscript image: " + path);
+        }
+        std::memcpy(&header, data.data(), sizeof header);
+        if (std::memcmp(header.magic, image::MAGIC, sizeof header.magic) != 0) {
+            throw CalcError("Not a calscript image: " + path);
+        }
+        if (header.byteOrder != image::BYTE_ORDER_MARK || header.instructionSize != sizeof(Instruction)) {
+            throw CalcError("Image " + path + " was written on an incompatible machine");
+        }
+        if (header.version != image::VERSION) {
+            throw CalcError("Unsupported image version " + std::to_string(header.version) + " in " + path +
+                            " (expected " + std::to_string(image::VERSION) + ")");
+        }
+
+        Layout layout(header);
+        if (data.size() < layout.end) throw corrupt("file is truncated");
+
+        // Entries are copied out rather than cast in place, so the mapping needs no alignment
+        auto entry = [&data](uint64_t section, size_t index, auto& out) {
+            std::memcpy(&out, data.data() + section + index * sizeof out, sizeof out);
+        };
+        std::string_view textSection = data.substr(layout.text, header.textSize);
+        auto text = [&](const image::TextRef& ref) {
+            if (ref.offset > textSection.size() || ref.length > textSection.size() - ref.offset) {
+                throw corrupt("text out of range");
+            }
+            return textSection.substr(ref.offset, ref.length);
+        };
+
+        std::vector<SymbolId> symbols(header.symbolCount);
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            image::TextRef ref;
+            entry(layout.symbols, i, ref);
+            std::string_view name = text(ref);
+            if (!isIdentifier(name)) throw corrupt("invalid name");
+            symbols[i] = SymbolTable::global().intern(name);
+        }
+        auto symbol = [&](uint32_t index) {
+            if (index >= symbols.size()) throw corrupt("symbol index out of range");
+            return symbols[index];
+        };
+
+        functions_.reserve(header.functionCount);
+        for (size_t i = 0; i < header.functionCount; ++i) {
+            image::FunctionEntry fn;
+            entry(layout.functions, i, fn);
+            Function& func = functions_.emplace_back();
+            func.name = symbol(fn.name);
+            const std::string& name = SymbolTable::global().name(func.name);
+            func.body = text(fn.body);
+
+            if (uint64_t(fn.firstParam) + fn.paramCount > header.paramCount ||
+                uint64_t(fn.firstInstruction) + fn.instructionCount > header.instructionCount) {
+                throw corrupt("function " + name + " is out of range");
+            }
+            for (size_t p = 0; p < fn.paramCount; ++p) {
+                uint32_t param;
+                entry(layout.params, fn.firstParam + p, param);
+                func.params.push_back(symbol(param));
+            }
+
+            // Replays the stack effect of every instruction, so a program can never read or
+            // write outside the stack and locals that execute sizes from these counts
+            if (fn.localCount > fn.instructionCount) throw corrupt("function " + name + " has too many locals");
+            size_t depth = 0;
+            size_t maxDepth = 0;
+            auto pop = [&](size_t count) {
+                if (depth < count) throw corrupt("function " + name + " underflows its stack");
+                depth -= count;
+            };
+            for (size_t k = 0; k < fn.instructionCount; ++k) {
+                Instruction ins;
+                entry(layout.code, fn.firstInstruction + k, ins);
+                switch (ins.op) {
+                    case OpCode::LoadVar:
+                        ins.operand = symbol(ins.operand);
+                        break;
+                    case OpCode::LoadParam:
+                        if (ins.operand >= fn.paramCount) throw corrupt("function " + name + " reads a missing parameter");
+                        break;
+                    case OpCode::LoadLocal:
+                        if (ins.operand >= fn.localCount) throw corrupt("function " + name + " reads a missing local");
+                        break;
+                    case OpCode::StoreLocal:
+                        if (ins.operand >= fn.localCount) throw corrupt("function " + name + " writes a missing local");
+                        pop(1);
+                        break;
+                    case OpCode::Add: case OpCode::Sub: case OpCode::Mul:
+                    case OpCode::Div: case OpCode::Mod: case OpCode::Pow:
+                        pop(2);
+                        break;
+                    case OpCode::Neg: case OpCode::Factorial:
+                    case OpCode::Sin: case OpCode::Cos: case OpCode::Tan:
+                    case OpCode::Log: case OpCode::Ln: case OpCode::Sqrt:
+                    case OpCode::Square: case OpCode::PowHalf:
+                        pop(1);
+                        break;
+                    case OpCode::Call:
+                        ins.operand = symbol(ins.operand);
+                        pop(ins.argc);
+                        break;
+                    case OpCode::PushConst:
+                    case OpCode::LoadAns:
+                        break;
+                    default:
+                        throw corrupt("function " + name + " has an unknown instruction");
+                }
+                if (ins.op != OpCode::StoreLocal) depth++;
+                maxDepth = std::max(maxDepth, depth);
+                func.program.append(ins);
+            }
+            if (depth != 1) throw corrupt("function " + name + " does not leave one result");
+            func.program.setMaxDepth(maxDepth);
+            func.program.setLocalCount(fn.localCount);
+        }
+
+        std::vector<bool> hasValue(symbols.size());
+        variables_.reserve(header.variableCount);
+        for (size_t i = 0; i < header.variableCount; ++i) {
+            image::VariableEntry var;
+            entry(layout.variables, i, var);
+            variables_.emplace_back(symbol(var.name), var.value);
+            hasValue[var.name] = true;
+        }
+
+        formulas_.reserve(header.formulaCount);
+        for (size_t i = 0; i < header.formulaCount; ++i) {
+            image::FormulaEntry formula;
+            entry(layout.formulas, i, formula);
+            SymbolId name = symbol(formula.name);
+            if (!hasValue[formula.name]) throw corrupt("formula " + SymbolTable::global().name(name) + " has no value");
+            formulas_.emplace_back(name, text(formula.expression));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include "Jit.hpp"
+#include "Calculator.hpp"
+#include "Operations.hpp"
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(CALSCRIPT_NO_JIT)
+    #define CALSCRIPT_HAS_JIT 1
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace calc {
+#ifdef CALSCRIPT_HAS_JIT
+    namespace {
+        static_assert(std::is_standard_layout_v<JitContext>, "generated code addresses JitContext by offset");
+
+        // Registers, numbered as in instruction encodings
+        enum Reg : int { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RSI = 6, RDI = 7, R12 = 12 };
+
+        // Condition codes for jcc
+        enum Cond : uint8_t { EQUAL = 0x4, NOT_EQUAL = 0x5, BELOW_EQUAL = 0x6, ABOVE = 0x7, PARITY = 0xA };
+
+        // Stack slot s lives in xmm(FIRST_SLOT + s); xmm0 and xmm1 are scratch and helper arguments
+        constexpr int FIRST_SLOT = 2;
+        constexpr size_t MAX_SLOTS = 16 - FIRST_SLOT;
+
+        // Helpers called from generated code. None of them throws: a failure sets
+        // context->failed and the generated code returns at once.
+        double helperPow(double a, double b) { return std::pow(a, b); }
+
+        double helperMod(JitContext* context, double a, double b) {
+            if (!Operations::isDefined(OpCode::Mod, a, b)) {
+                context->failed = 1;
+                return 0;
+            }
+            return Operations::modulo(a, b);
+        }
+
+        double helperUnary(JitContext* context, uint32_t op, double a) {
+            OpCode code = static_cast<OpCode>(op);
+            if (!Operations::isDefined(code, a)) {
+                context->failed = 1;
+                return 0;
+            }
+            return Operations::apply(code, a);
+        }
+
+        class Assembler {
+            public:
+                std::vector<uint8_t>& code() { return code_; }
+                size_t position() const { return code_.size(); }
+
+                void byte(uint8_t b) { code_.push_back(b); }
+                void dword(uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+                void qword(uint64_t v) { for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (8 * i))); }
+
+                // REX prefix, emitted only when it carries something
+                void rex(bool wide, int reg, int rm) {
+                    uint8_t value = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) & 1) << 2 | ((rm >> 3) & 1);
+                    if (value != 0x40) byte(value);
+                }
+                void modrmReg(int reg, int rm) { byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))); }
+                // [base + disp32]; rsp and r12 as base need a SIB byte
+                void modrmMem(int reg, int base, int32_t disp) {
+                    byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+                    if ((base & 7) == RSP) byte(0x24);
+                    dword(static_cast<uint32_t>(disp));
+                }
+
+                // Scalar double instructions: prefix 0F op
+                void sse(uint8_t prefix, uint8_t op, int dst, int src) {
+                    byte(prefix);
+                    rex(false, dst, src);
+                    byte(0x0F);
+                    byte(op);
+                    modrmReg(dst, src);
+                }
+                void sseMem(uint8_t prefix, uint8_t op, int xmm, int base, int32_t disp) {
+                    byte(prefix);
+                    rex(false, xmm, base);
+                    byte(0x0F);
+                    byte(op);
+                    modrmMem(xmm, base, disp);
+                }
+
+                void movsd(int dst, int src) { if (dst != src) sse(0xF2, 0x10, dst, src); }
+                void load(int xmm, int base, int32_t disp) { sseMem(0xF2, 0x10, xmm, base, disp); }
+                void store(int base, int32_t disp, int xmm) { sseMem(0xF2, 0x11, xmm, base, disp); }
+                void addsd(int dst, int src) { sse(0xF2, 0x58, dst, src); }
+                void mulsd(int dst, int src) { sse(0xF2, 0x59, dst, src); }
+                void subsd(int dst, int src) { sse(0xF2, 0x5C, dst, src); }
+                void divsd(int dst, int src) { sse(0xF2, 0x5E, dst, src); }
+                void sqrtsd(int dst, int src) { sse(0xF2, 0x51, dst, src); }
+                void xorpd(int dst, int src) { sse(0x66, 0x57, dst, src); }
+                void ucomisd(int a, int b) { sse(0x66, 0x2E, a, b); }
+
+                void movqFromGpr(int xmm, int gpr) {
+                    byte(0x66);
+                    rex(true, xmm, gpr);
+                    byte(0x0F);
+                    byte(0x6E);
+                    modrmReg(xmm, gpr);
+                }
+                void movImm64(int reg, uint64_t value) {
+                    rex(true, 0, reg);
+                    byte(static_cast<uint8_t>(0xB8 + (reg & 7)));
+                    qword(value);
+                }
+                void movImm32(int reg, uint32_t value) {
+                    rex(false, 0, reg);
+                    byte(static_cast<uint8_t>(0xB8 + (reg & 7)));
+                    dword(value);
+                }
+                void movReg(int dst, int src) {
+                    rex(true, src, dst);
+                    byte(0x89);
+                    modrmReg(src, dst);
+                }
+                void lea(int reg, int base, int32_t disp) {
+                    rex(true, reg, base);
+                    byte(0x8D);
+                    modrmMem(reg, base, disp);
+                }
+                void callMem(int base, int32_t disp) {
+                    rex(false, 0, base);
+                    byte(0xFF);
+                    modrmMem(2, base, disp);
+                }
+                void callAbsolute(const void* target) {
+                    movImm64(RAX, reinterpret_cast<uint64_t>(target));
+                    byte(0xFF);
+                    byte(0xD0);  // call rax
+                }
+                void cmpByteZero(int base, int32_t disp) {
+                    rex(false, 0, base);
+                    byte(0x80);
+                    modrmMem(7, base, disp);
+                    byte(0);
+                }
+                void movByte(int base, int32_t disp, uint8_t value) {
+                    rex(false, 0, base);
+                    byte(0xC6);
+                    modrmMem(0, base, disp);
+                    byte(value);
+                }
+                void push(int reg) { rex(false, 0, reg); byte(static_cast<uint8_t>(0x50 + (reg & 7))); }
+                void pop(int reg) { rex(false, 0, reg); byte(static_cast<uint8_t>(0x58 + (reg & 7))); }
+                void adjustRsp(bool subtract, uint32_t bytes) {
+                    byte(0x48);
+                    byte(0x81);
+                    byte(subtract ? 0xEC : 0xC4);
+                    dword(bytes);
+                }
+                void ret() { byte(0xC3); }
+
+                // Forward jumps return the position of their rel32, patched by bind
+                size_t jump() {
+                    byte(0xE9);
+                    dword(0);
+                    return position() - 4;
+                }
+                size_t jumpIf(Cond cond) {
+                    byte(0x0F);
+                    byte(static_cast<uint8_t>(0x80 | cond));
+                    dword(0);
+                    return position() - 4;
+                }
+                void bind(size_t patch) { bindTo(patch, position()); }
+                void bindTo(size_t patch, size_t target) {
+                    uint32_t rel = static_cast<uint32_t>(target - (patch + 4));
+                    std::memcpy(&code_[patch], &rel, sizeof rel);
+                }
+
+            private:
+                std::vector<uint8_t> code_;
+        };
+
+        // Translates one program instruction at a time, tracking the stack depth
+        class CodeGenerator {
+            public:
+                explicit CodeGenerator(const Program& program)
+                    : program_(program),
+                      spillBase_(static_cast<int32_t>(8 * program.getLocalCount())) {
+                    // After pushing rbx and r12 the stack is 8 bytes off 16-byte alignment;
+                    // the frame (locals, then spill slots) restores it for helper calls
+                    frameSize_ = static_cast<uint32_t>(8 * (program.getLocalCount() + MAX_SLOTS));
+                    if (frameSize_ % 16 == 0) frameSize_ += 8;
+                }
+
+                bool generate() {
+                    if (program_.getMaxDepth() > MAX_SLOTS || program_.empty()) return false;
+
+                    a_.push(RBX);
+                    a_.push(R12);
+                    a_.adjustRsp(true, frameSize_);
+                    a_.movReg(R12, RDI);  // frame
+                    a_.movReg(RBX, RSI);  // context
+
+                    for (const Instruction& ins : program_.getCode()) {
+                        if (!emit(ins)) return false;
+                    }
+                    if (sp_ != 1) return false;
+
+                    a_.movsd(0, slot(0));
+                    size_t exit = a_.position();
+                    a_.adjustRsp(false, frameSize_);
+                    a_.pop(R12);
+                    a_.pop(RBX);
+                    a_.ret();
+
+                    // Abandons the call for the interpreter to rerun
+                    size_t bail = a_.position();
+                    a_.movByte(RBX, offsetof(JitContext, failed), 1);
+                    a_.bindTo(a_.jump(), exit);
+
+                    for (size_t patch : exits_) a_.bindTo(patch, exit);
+                    for (size_t patch : bails_) a_.bindTo(patch, bail);
+                    return true;
+                }
+
+                std::vector<uint8_t>& code() { return a_.code(); }
+
+            private:
+                const Program& program_;
+                Assembler a_;
+                size_t sp_{0};
+                int32_t spillBase_;
+                uint32_t frameSize_;
+                std::vector<size_t> exits_;
+                std::vector<size_t> bails_;
+
+                static int slot(size_t s) { return FIRST_SLOT + static_cast<int>(s); }
+                int32_t spillOffset(size_t s) const { return spillBase_ + static_cast<int32_t>(8 * s); }
+
+                // Helpers may clobber every xmm register, so live slots are saved around calls
+                void spill(size_t count) { for (size_t s = 0; s < count; ++s) a_.store(RSP, spillOffset(s), slot(s)); }
+                void reload(size_t count) { for (size_t s = 0; s < count; ++s) a_.load(slot(s), RSP, spillOffset(s)); }
+                void exitIfFailed() {
+                    a_.cmpByteZero(RBX, offsetof(JitContext, failed));
+                    exits_.push_back(a_.jumpIf(NOT_EQUAL));
+                }
+
+                // Calls target with the top operand in xmm0 (and the next in xmm1) and replaces
+                // the operands with its result
+                void callHelper(const void* target, size_t operands, bool canFail, uint32_t op = 0) {
+                    size_t below = sp_ - operands;
+                    spill(below);
+                    a_.movsd(0, slot(below));
+                    if (operands == 2) a_.movsd(1, slot(below + 1));
+                    a_.movReg(RDI, RBX);
+                    a_.movImm32(RSI, op);
+                    a_.callAbsolute(target);
+                    if (canFail) exitIfFailed();
+                    reload(below);
+                    a_.movsd(slot(below), 0);
+                    sp_ = below + 1;
+                }
+
+                bool emit(const Instruction& ins) {
+                    switch (ins.op) {
+                        case OpCode::PushConst: {
+                            uint64_t bits;
+                            std::memcpy(&bits, &ins.value, sizeof bits);
+                            if (bits == 0) {
+                                a_.xorpd(slot(sp_), slot(sp_));
+                            } else {
+                                a_.movImm64(RAX, bits);
+                                a_.movqFromGpr(slot(sp_), RAX);
+                            }
+                            sp_++;
+                            break;
+                        }
+
+                        case OpCode::LoadParam:
+                            a_.load(slot(sp_++), R12, static_cast<int32_t>(8 * ins.operand));
+                            break;
+
+                        case OpCode::LoadLocal:
+                            a_.load(slot(sp_++), RSP, static_cast<int32_t>(8 * ins.operand));
+                            break;
+
+                        case OpCode::StoreLocal:
+                            a_.store(RSP, static_cast<int32_t>(8 * ins.operand), slot(--sp_));
+                            break;
+
+                        case OpCode::LoadAns:
+                            a_.load(slot(sp_++), RBX, offsetof(JitContext, ans));
+                            break;
+
+                        case OpCode::LoadVar:
+                            spill(sp_);
+                            a_.movReg(RDI, RBX);
+                            a_.movImm32(RSI, ins.operand);
+                            a_.callMem(RBX, offsetof(JitContext, loadVariable));
+                            exitIfFailed();
+                            reload(sp_);
+                            a_.movsd(slot(sp_++), 0);
+                            break;
+
+                        case OpCode::Call: {
+                            spill(sp_);  // the arguments become the callee's frame
+                            size_t first = sp_ - ins.argc;
+                            a_.movReg(RDI, RBX);
+                            a_.movImm32(RSI, ins.operand);
+                            a_.lea(RDX, RSP, spillOffset(first));
+                            a_.movImm32(RCX, ins.argc);
+                            a_.callMem(RBX, offsetof(JitContext, callFunction));
+                            exitIfFailed();
+                            reload(first);
+                            a_.movsd(slot(first), 0);
+                            sp_ = first + 1;
+                            break;
+                        }
+
+                        case OpCode::Add:
+                            a_.addsd(slot(sp_ - 2), slot(sp_ - 1));
+                            sp_--;
+                            break;
+
+                        case OpCode::Sub:
+                            a_.subsd(slot(sp_ - 2), slot(sp_ - 1));
+                            sp_--;
+                            break;
+
+                        case OpCode::Mul:
+                            a_.mulsd(slot(sp_ - 2), slot(sp_ - 1));
+                            sp_--;
+                            break;
+
+                        case OpCode::Div: {
+                            // Division by zero (or -0) is an error; NaN divides normally
+                            a_.xorpd(0, 0);
+                            a_.ucomisd(slot(sp_ - 1), 0);
+                            size_t unordered = a_.jumpIf(PARITY);
+                            bails_.push_back(a_.jumpIf(EQUAL));
+                            a_.bind(unordered);
+                            a_.divsd(slot(sp_ - 2), slot(sp_ - 1));
+                            sp_--;
+                            break;
+                        }
+
+                        case OpCode::Mod:
+                            callHelper(reinterpret_cast<const void*>(&helperMod), 2, true);
+                            break;
+
+                        case OpCode::Pow:
+                            callHelper(reinterpret_cast<const void*>(&helperPow), 2, false);
+                            break;
+
+                        case OpCode::Neg:
+                            a_.movImm64(RAX, 0x8000000000000000ull);
+                            a_.movqFromGpr(0, RAX);
+                            a_.xorpd(slot(sp_ - 1), 0);
+                            break;
+
+                        case OpCode::Square:
+                            a_.mulsd(slot(sp_ - 1), slot(sp_ - 1));
+                            break;
+
+                        case OpCode::Sqrt:
+                            // Negative arguments are an error; NaN and -0 go through sqrtsd
+                            a_.xorpd(0, 0);
+                            a_.ucomisd(0, slot(sp_ - 1));
+                            bails_.push_back(a_.jumpIf(ABOVE));
+                            a_.sqrtsd(slot(sp_ - 1), slot(sp_ - 1));
+                            break;
+
+                        case OpCode::PowHalf: {
+                            // Positive values take sqrtsd; zero, negatives and NaN call the helper
+                            a_.xorpd(0, 0);
+                            a_.ucomisd(slot(sp_ - 1), 0);
+                            size_t slow = a_.jumpIf(BELOW_EQUAL);
+                            a_.sqrtsd(slot(sp_ - 1), slot(sp_ - 1));
+                            size_t done = a_.jump();
+                            a_.bind(slow);
+                            callHelper(reinterpret_cast<const void*>(&Operations::powHalf), 1, false);
+                            a_.bind(done);
+                            break;
+                        }
+
+                        case OpCode::Factorial:
+                        case OpCode::Sin:
+                        case OpCode::Cos:
+                        case OpCode::Tan:
+                        case OpCode::Log:
+                        case OpCode::Ln:
+                            callHelper(reinterpret_cast<const void*>(&helperUnary), 1, true,
+                                       static_cast<uint32_t>(ins.op));
+                            break;
+
+                        default:
+                            return false;
+                    }
+                    return true;
+                }
+        };
+    }
+
+    bool JitCode::isAvailable() { return true; }
+
+    std::shared_ptr<const JitCode> JitCode::compile(const Program& program) {
+        CodeGenerator generator(program);
+        if (!generator.generate()) return nullptr;
+
+        // Written while writable, then made executable (never both at once)
+        const std::vector<uint8_t>& code = generator.code();
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t size = (code.size() + page - 1) / page * page;
+        void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+        std::memcpy(memory, code.data(), code.size());
+        if (::mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            ::munmap(memory, size);
+            return nullptr;
+        }
+        return std::shared_ptr<const JitCode>(new JitCode(memory, size));
+    }
+
+    JitCode::JitCode(void* memory, size_t size)
+        : memory_(memory), size_(size), entry_(reinterpret_cast<Entry>(memory)) {}
+
+    JitCode::~JitCode() {
+        ::munmap(memory_, size_);
+    }
+#else
+    bool JitCode::isAvailable() { return false; }
+
+    std::shared_ptr<const JitCode> JitCode::compile(const Program&) { return nullptr; }
+
+    JitCode::JitCode(void* memory, size_t size) : memory_(memory), size_(size), entry_(nullptr) {}
+
+    JitCode::~JitCode() = default;
+#endif
+}
\ No newline at end of file
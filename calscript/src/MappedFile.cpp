@@ -0,0 +1,66 @@
+#include "MappedFile.hpp"
+#include "Token.hpp"
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace calc {
+    MappedFile::MappedFile(const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw CalcError("Cannot open " + path);
+        }
+
+        struct stat info;
+        bool known = ::fstat(fd, &info) == 0;
+        // open succeeds on a directory, and reading one just looks like an empty file
+        if (known && S_ISDIR(info.st_mode)) {
+            ::close(fd);
+            throw CalcError("Cannot open " + path + ": is a directory");
+        }
+        if (known && S_ISREG(info.st_mode)) {
+            size_ = static_cast<size_t>(info.st_size);
+            if (size_ == 0) {
+                ::close(fd);
+                return;
+            }
+
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(addr);
+                mapped_ = true;
+                ::close(fd);
+                return;
+            }
+        }
+        ::close(fd);
+#endif
+
+        // Not a regular file (or no mmap): read it into memory instead
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw CalcError("Cannot open " + path);
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        buffer_ = contents.str();
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+
+    MappedFile::~MappedFile() {
+#ifndef _WIN32
+        if (mapped_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+    }
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "MemoCache.hpp"
+#include <cstring>
+
+namespace calc {
+    MemoCache::Key MemoCache::makeKey(const double* args, size_t argc) {
+        Key key(argc);
+        if (argc > 0) std::memcpy(key.data(), args, argc * sizeof(double));
+        return key;
+    }
+
+    size_t MemoCache::KeyHash::operator()(const Key& key) const {
+        // FNV-1a over the argument words
+        uint64_t hash = 1469598103934665603ULL;
+        for (uint64_t word : key) {
+            hash ^= word;
+            hash *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+
+    void MemoCache::sync(uint64_t epoch) {
+        if (epoch != epoch_) {
+            entries_.clear();
+            index_.clear();
+            epoch_ = epoch;
+        }
+    }
+
+    std::optional<double> MemoCache::find(const Key& key, uint64_t epoch) {
+        sync(epoch);
+
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_++;
+            return std::nullopt;
+        }
+        hits_++;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->value;
+    }
+
+    void MemoCache::insert(Key key, double value, uint64_t epoch) {
+        sync(epoch);
+        if (capacity_ == 0 || index_.count(key)) return;
+
+        if (index_.size() >= capacity_) {
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+        entries_.push_front({std::move(key), value});
+        index_.emplace(entries_.front().key, entries_.begin());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "Operations.hpp"
+#include "Constants.hpp"
+#include <limits>
+#include <string>
+
+namespace calc {
+    double Operations::factorial(double a) {
+        if (a < 0 || std::floor(a) != a) throw CalcError("Factorial requires non-negative integer");
+        // Anything larger overflows anyway, so huge arguments (and inf) end at once
+        if (a > Constants::MAX_FACTORIAL) return std::numeric_limits<double>::infinity();
+        double result = 1;
+        for (int i = 2; i <= a; ++i) result *= i;
+        return result;
+    }
+
+    double Operations::mathFunction(OpCode op, double a) {
+        constexpr double DEG_TO_RAD = Constants::PI / 180.0;
+        constexpr double EPSILON = 1e-10;
+        if (op == OpCode::Sin) {
+            double result = std::sin(a * DEG_TO_RAD);
+            if(std::abs(result) < EPSILON) return 0;
+            if(std::abs(result - 1) < EPSILON) return 1;
+            if(std::abs(result + 1) < EPSILON) return -1;
+            return result;
+        }
+        if (op == OpCode::Cos) {
+            double result = std::cos(a * DEG_TO_RAD);
+            if(std::abs(result) < EPSILON) return 0;
+            if(std::abs(result - 1) < EPSILON) return 1;
+            if(std::abs(result + 1) < EPSILON) return -1;
+            return result;
+        }
+        if (op == OpCode::Tan) {
+            if(std::fmod(std::abs(a), 180) == 90) {
+                throw CalcError("Tangent undefined at 90 (and its odd multiples)");
+            }
+            return std::tan(a * DEG_TO_RAD);
+        }
+        if (op == OpCode::Log) return std::log10(a);
+        if (op == OpCode::Ln) return std::log(a);
+        if (op == OpCode::Sqrt) {
+            if (a < 0) throw CalcError("Square root of negative number");
+            return std::sqrt(a);
+        }
+        throw CalcError("Unknown function opcode: " + std::to_string(static_cast<int>(op)));
+    }
+
+    double Operations::apply(OpCode op, double a, double b) {
+        switch (op) {
+            case OpCode::Add: return a + b;
+            case OpCode::Sub: return a - b;
+            case OpCode::Mul: return a * b;
+            case OpCode::Div: return divide(a, b);
+            case OpCode::Mod: return modulo(a, b);
+            case OpCode::Pow: return std::pow(a, b);
+            case OpCode::Neg: return -a;
+            case OpCode::Square: return a * a;
+            case OpCode::PowHalf: return powHalf(a);
+            case OpCode::Factorial: return factorial(a);
+            case OpCode::Sin:
+            case OpCode::Cos:
+            case OpCode::Tan:
+            case OpCode::Log:
+            case OpCode::Ln:
+            case OpCode::Sqrt:
+                return mathFunction(op, a);
+            default:
+                throw CalcError("Not an arithmetic instruction: " + std::to_string(static_cast<int>(op)));
+        }
+    }
+}
\ No newline at end of file
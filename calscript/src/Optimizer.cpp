@@ -0,0 +1,322 @@
+#include "Optimizer.hpp"
+#include "Calculator.hpp"
+#include "Operations.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace calc {
+    namespace {
+        // Inlining limits: callee size, nesting of inlined calls, and size of the result
+        constexpr size_t INLINE_MAX_INSTRUCTIONS = 32;
+        constexpr size_t INLINE_MAX_DEPTH = 4;
+        constexpr size_t INLINE_MAX_TOTAL = 512;
+
+        // Expression tree rebuilt from the postfix code; children are indices into the node list
+        struct Node {
+            Instruction ins;
+            std::vector<size_t> children;
+        };
+
+        size_t arity(const Instruction& ins) {
+            switch (ins.op) {
+                case OpCode::PushConst:
+                case OpCode::LoadVar:
+                case OpCode::LoadParam:
+                case OpCode::LoadAns:
+                case OpCode::LoadLocal:
+                    return 0;
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mul:
+                case OpCode::Div:
+                case OpCode::Mod:
+                case OpCode::Pow:
+                    return 2;
+                case OpCode::Call:
+                    return ins.argc;
+                default:
+                    return 1;
+            }
+        }
+
+        // Value of op applied to constant operands, or nothing if the interpreter would throw
+        // (or, for calls and loads, if the value is only known at run time)
+        std::optional<double> fold(OpCode op, const std::vector<double>& args) {
+            double a = args.empty() ? 0 : args[0];
+            double b = args.size() > 1 ? args[1] : 0;
+            if (!Operations::isDefined(op, a, b)) return std::nullopt;
+            return Operations::apply(op, a, b);
+        }
+
+        class Rewriter {
+            public:
+                explicit Rewriter(std::vector<Node>& nodes) : nodes_(nodes) {}
+
+                // Simplifies the tree under root and returns the index of its replacement
+                size_t simplify(size_t root);
+
+            private:
+                std::vector<Node>& nodes_;
+
+                bool isConst(size_t index) const { return nodes_[index].ins.op == OpCode::PushConst; }
+                bool isConst(size_t index, double value) const {
+                    // Compares bits so -0 is not mistaken for 0
+                    return isConst(index) && nodes_[index].ins.value == value &&
+                           std::signbit(nodes_[index].ins.value) == std::signbit(value);
+                }
+
+                // Rewrites one node whose children are already simplified
+                size_t simplifyNode(size_t index);
+        };
+
+        // Nodes are in postfix order, so children come before their parents and a single pass
+        // simplifies every subtree before the node above it, however deep the tree is
+        size_t Rewriter::simplify(size_t root) {
+            std::vector<size_t> replacement(root + 1);
+            for (size_t index = 0; index <= root; ++index) {
+                for (auto& child : nodes_[index].children) child = replacement[child];
+                replacement[index] = simplifyNode(index);
+            }
+            return replacement[root];
+        }
+
+        size_t Rewriter::simplifyNode(size_t index) {
+            Node& node = nodes_[index];
+            const auto& kids = node.children;
+
+            // Constant folding
+            if (!kids.empty() && node.ins.op != OpCode::Call) {
+                bool allConst = true;
+                std::vector<double> args;
+                for (size_t child : kids) {
+                    allConst = allConst && isConst(child);
+                    if (allConst) args.push_back(nodes_[child].ins.value);
+                }
+                if (allConst) {
+                    if (auto value = fold(node.ins.op, args)) {
+                        node.ins = Instruction{OpCode::PushConst, 0, 0, *value};
+                        node.children.clear();
+                        return index;
+                    }
+                }
+            }
+
+            // Only rewrites that give identical results for every input, including
+            // -0, infinities and NaN (so x+0 and x*0 are left alone)
+            switch (node.ins.op) {
+                case OpCode::Pow:
+                    if (isConst(kids[1], 1)) return kids[0];
+                    if (isConst(kids[1], 2)) {
+                        node.ins = Instruction{OpCode::Square};
+                        node.children.pop_back();
+                    } else if (isConst(kids[1], 0.5)) {
+                        node.ins = Instruction{OpCode::PowHalf};
+                        node.children.pop_back();
+                    }
+                    break;
+                case OpCode::Mul:
+                    if (isConst(kids[1], 1)) return kids[0];
+                    if (isConst(kids[0], 1)) return kids[1];
+                    break;
+                case OpCode::Div:
+                    if (isConst(kids[1], 1)) return kids[0];
+                    break;
+                case OpCode::Add:
+                    if (isConst(kids[1], -0.0)) return kids[0];
+                    if (isConst(kids[0], -0.0)) return kids[1];
+                    break;
+                case OpCode::Sub:
+                    if (isConst(kids[1], 0)) return kids[0];
+                    break;
+                case OpCode::Neg:
+                    if (nodes_[kids[0]].ins.op == OpCode::Neg) return nodes_[kids[0]].children[0];
+                    break;
+                default:
+                    break;
+            }
+            return index;
+        }
+
+        // Expands calls into a new instruction stream. While emitting it tracks, for each value
+        // on the (simulated) stack, where the code computing it starts, so the argument code of
+        // a call can be picked apart when the call is reached.
+        class Inliner {
+            public:
+                Inliner(const Calculator& calculator, std::vector<SymbolId>& callees)
+                    : calculator_(calculator), callees_(callees) {}
+
+                Program run(const Program& program) {
+                    std::vector<Instruction> params;  // top level: parameters stay parameters
+                    expand(program.getCode(), params, 0);
+
+                    Program linked;
+                    for (const auto& ins : out_) linked.append(ins);
+                    linked.setMaxDepth(maxDepth_);
+                    linked.setLocalCount(locals_);
+                    return linked;
+                }
+
+            private:
+                static constexpr size_t NO_START = std::numeric_limits<size_t>::max();
+
+                const Calculator& calculator_;
+                std::vector<SymbolId>& callees_;
+                std::vector<Instruction> out_;
+                std::vector<size_t> starts_;        // start in out_ of each value on the stack
+                size_t pendingStart_{NO_START};     // start of arguments stored ahead of an inlined body
+                size_t maxDepth_{0};
+                uint32_t locals_{0};
+                std::vector<SymbolId> active_;      // functions being expanded, to stop at cycles
+
+                // Arguments that are free to evaluate and cannot fail are substituted, not stored
+                static bool isSimple(const Instruction& ins) {
+                    return ins.op == OpCode::PushConst || ins.op == OpCode::LoadParam ||
+                           ins.op == OpCode::LoadLocal;
+                }
+
+                void emit(const Instruction& ins) {
+                    size_t pops = ins.op == OpCode::StoreLocal ? 1 : arity(ins);
+                    size_t start = out_.size();
+                    if (pops > 0) {
+                        start = starts_[starts_.size() - pops];
+                        starts_.resize(starts_.size() - pops);
+                    }
+                    out_.push_back(ins);
+
+                    if (ins.op == OpCode::StoreLocal) {
+                        pendingStart_ = std::min(pendingStart_, start);
+                        return;
+                    }
+                    // The first value an inlined body pushes owns its stored arguments
+                    starts_.push_back(std::min(start, pendingStart_));
+                    pendingStart_ = NO_START;
+                    maxDepth_ = std::max(maxDepth_, starts_.size());
+                }
+
+                void expand(const std::vector<Instruction>& code, const std::vector<Instruction>& params, size_t depth) {
+                    for (const auto& ins : code) {
+                        if (ins.op == OpCode::LoadParam && !params.empty()) {
+                            emit(params[ins.operand]);
+                        } else if (ins.op == OpCode::Call) {
+                            expandCall(ins, depth);
+                        } else {
+                            emit(ins);
+                        }
+                    }
+                }
+
+                void expandCall(const Instruction& call, size_t depth) {
+                    callees_.push_back(call.operand);
+
+                    const Calculator::Function* callee = calculator_.getFunction(call.operand);
+                    bool inlinable = callee && !calculator_.isMemoized(call.operand) &&
+                                     callee->getParameters().size() == call.argc &&
+                                     callee->getBaseProgram().getCode().size() <= INLINE_MAX_INSTRUCTIONS &&
+                                     depth < INLINE_MAX_DEPTH && out_.size() < INLINE_MAX_TOTAL &&
+                                     std::find(active_.begin(), active_.end(), call.operand) == active_.end();
+                    if (!inlinable) {
+                        emit(call);
+                        return;
+                    }
+
+                    // Take the argument code back out of the stream...
+                    std::vector<size_t> argStarts(starts_.end() - call.argc, starts_.end());
+                    starts_.resize(starts_.size() - call.argc);
+                    size_t base = call.argc > 0 ? argStarts[0] : out_.size();
+                    std::vector<Instruction> argCode(out_.begin() + base, out_.end());
+                    out_.resize(base);
+
+                    // ...and re-emit it in the same order, storing each argument into a local
+                    std::vector<Instruction> params(call.argc);
+                    for (size_t i = 0; i < call.argc; ++i) {
+                        size_t begin = argStarts[i] - base;
+                        size_t end = i + 1 < call.argc ? argStarts[i + 1] - base : argCode.size();
+
+                        if (end - begin == 1 && isSimple(argCode[begin])) {
+                            params[i] = argCode[begin];
+                            continue;
+                        }
+                        for (size_t j = begin; j < end; ++j) emit(argCode[j]);
+                        uint32_t slot = locals_++;
+                        emit(Instruction{OpCode::StoreLocal, 0, slot});
+                        params[i] = Instruction{OpCode::LoadLocal, 0, slot};
+                    }
+
+                    active_.push_back(call.operand);
+                    expand(callee->getBaseProgram().getCode(), params, depth + 1);
+                    active_.pop_back();
+                }
+        };
+
+        // Emits the tree in postfix order; returns the stack depth it needs. Walks with an
+        // explicit stack, since bodies can be chains of hundreds of thousands of operators.
+        size_t emitTree(const std::vector<Node>& nodes, size_t root, Program& program) {
+            struct Pending {
+                size_t index;
+                size_t next;   // child to emit next
+                size_t depth;  // depth needed by the children emitted so far (and the node itself)
+            };
+            std::vector<Pending> pending{{root, 0, 1}};
+            size_t emitted = 0;  // depth needed by the subtree finished last
+
+            while (!pending.empty()) {
+                Pending& top = pending.back();
+                const auto& children = nodes[top.index].children;
+                if (top.next < children.size()) {
+                    size_t child = children[top.next];
+                    pending.push_back({child, 0, 1});
+                    continue;
+                }
+
+                program.append(nodes[top.index].ins);
+                emitted = top.depth;
+                pending.pop_back();
+                if (!pending.empty()) {
+                    // The child's values sit above the ones its earlier siblings left
+                    Pending& parent = pending.back();
+                    parent.depth = std::max(parent.depth, parent.next + emitted);
+                    parent.next++;
+                }
+            }
+            return emitted;
+        }
+    }
+
+    Program Optimizer::optimize(const Program& program) {
+        std::vector<Node> nodes;
+        std::vector<size_t> stack;
+        nodes.reserve(program.getCode().size());
+
+        for (const auto& ins : program.getCode()) {
+            if (ins.op == OpCode::StoreLocal || ins.op == OpCode::LoadLocal) return program;  // already linked
+
+            size_t count = arity(ins);
+            if (stack.size() < count) return program;  // not produced by the Compiler; leave it alone
+
+            Node node{ins, std::vector<size_t>(stack.end() - count, stack.end())};
+            stack.resize(stack.size() - count);
+            nodes.push_back(std::move(node));
+            stack.push_back(nodes.size() - 1);
+        }
+        if (stack.size() != 1) return program;
+
+        size_t root = Rewriter(nodes).simplify(stack[0]);
+
+        Program optimized;
+        optimized.setMaxDepth(emitTree(nodes, root, optimized));
+        return optimized;
+    }
+
+    Program Optimizer::inlineCalls(const Program& program, const Calculator& calculator,
+                                   std::vector<SymbolId>& callees) {
+        Inliner inliner(calculator, callees);
+        Program linked = inliner.run(program);
+
+        std::sort(callees.begin(), callees.end());
+        callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+        return linked;
+    }
+}
\ No newline at end of file
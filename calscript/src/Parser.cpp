@@ -0,0 +1,429 @@
+#include "Parser.hpp"
+#include "Calculator.hpp"
+#include "Constants.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace calc {
+    namespace {
+        // Binding strength of each operator, indexed by Operator. Prefix operators bind
+        // tighter than everything after them, so -x^2 is (-x)^2 and sin x! is (sin x)!.
+        // Only '^' groups right to left.
+        constexpr size_t OPERATOR_COUNT = static_cast<size_t>(Operator::Count);
+
+        constexpr int PRECEDENCE[OPERATOR_COUNT] = {
+            0,                      // None
+            1, 1, 2, 2, 2, 3,       // + - * / % ^
+            4, 6,                   // ! neg
+            5, 5, 5, 5, 5, 5,       // sin cos tan log ln sqrt
+            0, 0                    // ( )
+        };
+
+        constexpr bool RIGHT_ASSOCIATIVE[OPERATOR_COUNT] = {
+            false,
+            false, false, false, false, false, true,
+            false, false,
+            false, false, false, false, false, false,
+            false, false
+        };
+
+        constexpr size_t index(Operator op) { return static_cast<size_t>(op); }
+
+        void skipSpace(std::string_view& text) {
+            while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+        }
+
+        std::string_view trim(std::string_view text) {
+            skipSpace(text);
+            while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+            return text;
+        }
+
+        // Removes and returns the leading run of characters that are not whitespace
+        std::string_view takeField(std::string_view& text) {
+            size_t end = 0;
+            while (end < text.length() && !std::isspace(static_cast<unsigned char>(text[end]))) end++;
+            std::string_view field = text.substr(0, end);
+            text.remove_prefix(end);
+            return field;
+        }
+
+        bool equalsIgnoreCase(std::string_view text, std::string_view lower) {
+            return text.length() == lower.length() &&
+                   std::equal(text.begin(), text.end(), lower.begin(),
+                              [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+        }
+
+        // Removes and returns the leading identifier, if any
+        std::string_view takeWord(std::string_view& text) {
+            size_t end = 0;
+            if (!text.empty() && std::isalpha(static_cast<unsigned char>(text.front()))) {
+                while (end < text.length() &&
+                       (std::isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_')) end++;
+            }
+            std::string_view word = text.substr(0, end);
+            text.remove_prefix(end);
+            return word;
+        }
+
+        // Recursive descent over one token list. Operators are parsed by precedence climbing,
+        // so the tree matches what the earlier shunting-yard compiler produced.
+        class ExpressionParser {
+            public:
+                ExpressionParser(const Calculator* calculator, MemoryPool<Expr>& pool, const TokenList& tokens)
+                    : calculator_(calculator), pool_(pool), tokens_(tokens) {}
+
+                const Expr& parse() {
+                    if (tokens_.empty()) throw CalcError("Empty expression");
+                    const Expr* expr = parseBinary(1);
+                    if (pos_ < tokens_.size()) rejectLeftover();
+                    // Reported once the syntax is known to be fine, as it would be when run
+                    if (unknown_) throw undefined(*unknown_);
+                    return *expr;
+                }
+
+            private:
+                const Calculator* calculator_;
+                MemoryPool<Expr>& pool_;
+                const TokenList& tokens_;
+                size_t pos_{0};
+                size_t nesting_{0};
+                const Token* unknown_{nullptr};  // first word that is not a name anywhere
+
+                const Token* peek() const { return pos_ < tokens_.size() ? &tokens_[pos_] : nullptr; }
+                bool peekBracket(Operator bracket) const {
+                    const Token* token = peek();
+                    return token && token->getOperator() == bracket;
+                }
+
+                Expr* node(Expr::Kind kind) {
+                    Expr* expr = pool_.allocate();
+                    expr->kind = kind;
+                    return expr;
+                }
+                Expr* number(double value) {
+                    Expr* expr = node(Expr::Kind::Number);
+                    expr->value = value;
+                    return expr;
+                }
+                Expr* apply(Operator op, const Expr* lhs, const Expr* rhs = nullptr) {
+                    Expr* expr = node(rhs ? Expr::Kind::Binary : Expr::Kind::Unary);
+                    expr->op = op;
+                    expr->lhs = lhs;
+                    expr->rhs = rhs;
+                    return expr;
+                }
+
+                Expr* parseBinary(int minPrecedence);
+                Expr* parseOperand();
+                Expr* parseCall(const Token& name);
+                bool startsOperand(const Token* token) const;
+                [[noreturn]] void rejectLeftover() const;
+
+                // A word the symbol table has never seen names no variable in any calculator,
+                // so the error execute would report can be given without compiling
+                static CalcError undefined(const Token& token) {
+                    std::string name(token.getValue());
+                    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                    return CalcError("Undefined variable: " + name);
+                }
+        };
+
+        Expr* ExpressionParser::parseBinary(int minPrecedence) {
+            // Parentheses, prefix operators and right-associative chains all recurse through here
+            if (nesting_ >= Constants::MAX_NESTING) throw CalcError("Expression is nested too deeply");
+            nesting_++;
+
+            Expr* lhs = parseOperand();
+            while (const Token* token = peek()) {
+                Operator op;
+                if (token->getType() == Token::Type::Operator && token->getOperator() != Operator::Neg) {
+                    op = token->getOperator();
+                } else if (token->getOperator() == Operator::LeftParen) {
+                    op = Operator::Mul;  // a name followed by '(' that is not a function call
+                } else {
+                    break;
+                }
+
+                int precedence = PRECEDENCE[index(op)];
+                if (precedence < minPrecedence) break;
+                if (token->getType() == Token::Type::Operator) pos_++;
+
+                if (op == Operator::Factorial) {
+                    lhs = apply(op, lhs);
+                } else {
+                    const Expr* rhs = parseBinary(RIGHT_ASSOCIATIVE[index(op)] ? precedence : precedence + 1);
+                    lhs = apply(op, lhs, rhs);
+                }
+            }
+
+            nesting_--;
+            return lhs;
+        }
+
+        Expr* ExpressionParser::parseOperand() {
+            const Token* token = peek();
+            if (!token) throw CalcError("Invalid expression");
+
+            switch (token->getType()) {
+                case Token::Type::Number:
+                    pos_++;
+                    return number(token->getNumber());
+
+                case Token::Type::Boolean:
+                case Token::Type::Constant:
+                    pos_++;
+                    return number(SymbolTable::info(token->getSymbol()).value);
+
+                case Token::Type::PrevResult:
+                    pos_++;
+                    return node(Expr::Kind::Ans);
+
+                case Token::Type::Variable: {
+                    pos_++;
+                    // Standalone expressions bind every name themselves, so only a calculator
+                    // knows that a word the symbol table has never seen is undefined
+                    if (token->getSymbol() == NO_SYMBOL && calculator_ && !unknown_) unknown_ = token;
+                    if (peekBracket(Operator::LeftParen) && calculator_ && calculator_->functionExists(token->getSymbol())) {
+                        return parseCall(*token);
+                    }
+                    Expr* variable = node(Expr::Kind::Variable);
+                    variable->symbol = token->getSymbol();
+                    variable->name = token->getValue();
+                    return variable;
+                }
+
+                case Token::Type::MathFunction: {
+                    pos_++;
+                    bool emptyParens = peekBracket(Operator::LeftParen) && pos_ + 1 < tokens_.size() &&
+                                       tokens_[pos_ + 1].getOperator() == Operator::RightParen;
+                    if (!startsOperand(peek()) || emptyParens) throw CalcError("Function requires an argument");
+                    Operator op = token->getOperator();
+                    return apply(op, parseBinary(PRECEDENCE[index(op)] + 1));
+                }
+
+                case Token::Type::Operator:
+                    if (token->getOperator() != Operator::Neg) throw CalcError("Invalid expression");
+                    pos_++;
+                    return apply(Operator::Neg, parseBinary(PRECEDENCE[index(Operator::Neg)] + 1));
+
+                case Token::Type::Bracket: {
+                    if (token->getOperator() == Operator::RightParen) throw CalcError("Mismatched parenthesis");
+                    pos_++;
+                    if (peekBracket(Operator::RightParen)) throw CalcError("Empty expression");
+                    Expr* inner = parseBinary(1);
+                    if (!peekBracket(Operator::RightParen)) {
+                        if (pos_ < tokens_.size()) rejectLeftover();
+                        throw CalcError("Mismatched parenthesis");
+                    }
+                    pos_++;
+                    return inner;
+                }
+
+                case Token::Type::Comma:
+                case Token::Type::Colon:
+                case Token::Type::Command:
+                    break;
+            }
+            throw CalcError("Unexpected token in expression: " + std::string(token->getValue()));
+        }
+
+        // Parses name(arg, ...) with the cursor on '('. Empty arguments are skipped.
+        Expr* ExpressionParser::parseCall(const Token& name) {
+            std::string_view funcName = name.getValue();
+            auto unclosed = [&] {
+                return CalcError("Unclosed parenthesis in function call to " + std::string(funcName));
+            };
+
+            Expr* call = node(Expr::Kind::Call);
+            call->symbol = name.getSymbol();
+            call->name = funcName;
+            Expr* last = nullptr;
+
+            pos_++;  // '('
+            while (true) {
+                const Token* token = peek();
+                if (!token) throw unclosed();
+                if (token->getOperator() == Operator::RightParen) {
+                    pos_++;
+                    return call;
+                }
+                if (token->getType() == Token::Type::Comma) {
+                    pos_++;
+                    continue;
+                }
+
+                Expr* arg;
+                try {
+                    arg = parseBinary(1);
+                    if (pos_ < tokens_.size() && tokens_[pos_].getType() != Token::Type::Comma &&
+                        tokens_[pos_].getOperator() != Operator::RightParen) {
+                        rejectLeftover();
+                    }
+                } catch (const CalcError& e) {
+                    throw CalcError("In argument to " + std::string(funcName) + "(): " + e.what());
+                }
+
+                if (call->argc == UINT16_MAX) throw CalcError("Too many arguments to " + std::string(funcName));
+                call->argc++;
+                if (last) {
+                    last->next = arg;
+                } else {
+                    call->lhs = arg;
+                }
+                last = arg;
+            }
+        }
+
+        bool ExpressionParser::startsOperand(const Token* token) const {
+            if (!token) return false;
+            switch (token->getType()) {
+                case Token::Type::Number:
+                case Token::Type::Boolean:
+                case Token::Type::Constant:
+                case Token::Type::PrevResult:
+                case Token::Type::Variable:
+                case Token::Type::MathFunction:
+                    return true;
+                case Token::Type::Operator:
+                    return token->getOperator() == Operator::Neg;
+                case Token::Type::Bracket:
+                    return token->getOperator() == Operator::LeftParen;
+                default:
+                    return false;
+            }
+        }
+
+        // Reports the token the expression should have ended before
+        void ExpressionParser::rejectLeftover() const {
+            const Token& token = tokens_[pos_];
+            switch (token.getType()) {
+                case Token::Type::Bracket:
+                    throw CalcError("Mismatched parenthesis");
+                case Token::Type::Comma:
+                case Token::Type::Colon:
+                case Token::Type::Command:
+                    throw CalcError("Unexpected token in expression: " + std::string(token.getValue()));
+                default:
+                    throw CalcError("Invalid expression");
+            }
+        }
+    }
+
+    Statement Parser::parseStatement(std::string_view line) {
+        CALSCRIPT_PROFILE(profiler_, Profiler::Phase::Statement);
+        Statement statement;
+        std::string_view rest = line;
+        skipSpace(rest);
+        if (rest.empty()) return statement;
+
+        statement.kind = Statement::Kind::Expression;
+        statement.text = line;
+        if (line == "debug funcs") {
+            statement.kind = Statement::Kind::DebugFunctions;
+            return statement;
+        }
+
+        // Keywords are case-insensitive like every other name
+        std::string_view keyword = takeWord(rest);
+        if (keyword.empty()) return statement;
+        lowered_.assign(keyword);
+        std::transform(lowered_.begin(), lowered_.end(), lowered_.begin(), ::tolower);
+        auto symbol = SymbolTable::global().lookup(lowered_);
+        if (!symbol || SymbolTable::info(*symbol).kind != SymbolTable::Kind::Command) return statement;
+
+        statement.command = *symbol;
+        skipSpace(rest);
+
+        switch (*symbol) {
+            case SymbolTable::Def:
+            case SymbolTable::Upd:
+            case SymbolTable::Formula: {
+                const char* usage = *symbol == SymbolTable::Def ? "Usage: def <variable> <value>"
+                                  : *symbol == SymbolTable::Upd ? "Usage: upd <variable> <value>"
+                                  : "Usage: formula <variable> <expression>";
+                statement.kind = *symbol == SymbolTable::Def ? Statement::Kind::Define
+                               : *symbol == SymbolTable::Upd ? Statement::Kind::Update
+                               : Statement::Kind::Formula;
+                statement.name = takeField(rest);
+                if (statement.name.empty() || rest.empty()) throw CalcError(usage);
+                statement.text = trim(rest);
+                if (statement.text.empty()) {
+                    if (*symbol == SymbolTable::Def) throw CalcError("Variable definition requires a value.");
+                    if (*symbol == SymbolTable::Upd) throw CalcError("Variable update requires a value.");
+                    throw CalcError(usage);
+                }
+                return statement;
+            }
+
+            case SymbolTable::Create: {
+                if (rest.empty()) throw CalcError("Usage: create func <n>(params...): body");
+                if (!equalsIgnoreCase(takeWord(rest), "func")) throw CalcError("Unknown create command. Use 'create func'");
+
+                size_t open = rest.find('(');
+                if (open == std::string_view::npos) {
+                    throw CalcError("Invalid function syntax. Expected '(' after function name.");
+                }
+                size_t close = rest.find(')', open);
+                if (close == std::string_view::npos) {
+                    throw CalcError("Invalid function syntax. Missing ')' after parameters.");
+                }
+                size_t colon = rest.find(':', close);
+                if (colon == std::string_view::npos) {
+                    throw CalcError("Invalid function syntax. Expected ':' after parameters.");
+                }
+
+                statement.kind = Statement::Kind::CreateFunction;
+                statement.name = trim(rest.substr(0, open));
+                std::string_view params = rest.substr(open + 1, close - open - 1);
+                while (!trim(params).empty()) {
+                    size_t comma = params.find(',');
+                    statement.words.push_back(trim(params.substr(0, comma)));
+                    if (comma == std::string_view::npos) break;
+                    params.remove_prefix(comma + 1);
+                }
+
+                statement.text = rest.substr(colon + 1);
+                skipSpace(statement.text);
+                if (statement.text.empty()) throw CalcError("Function body cannot be empty.");
+                return statement;
+            }
+
+            case SymbolTable::Use: {
+                if (rest.empty()) throw CalcError("Usage: use func <n>(args...)");
+                if (!equalsIgnoreCase(takeWord(rest), "func")) throw CalcError("Unknown use command. Use 'use func'");
+
+                skipSpace(rest);
+                size_t open = rest.find('(');
+                if (open == std::string_view::npos) {
+                    throw CalcError("Invalid function call syntax. Expected '(' after function name.");
+                }
+                statement.kind = Statement::Kind::UseFunction;
+                statement.name = trim(rest.substr(0, open));
+                statement.text = rest;
+                return statement;
+            }
+
+            default:
+                statement.kind = Statement::Kind::Command;
+                while (!rest.empty()) {
+                    statement.words.push_back(takeField(rest));
+                    skipSpace(rest);
+                }
+                return statement;
+        }
+    }
+
+    const Expr& Parser::parseExpression(std::string_view text, TokenProcessor::Names names) {
+        TokenList tokens = [this, text, names] {
+            CALSCRIPT_PROFILE(profiler_, Profiler::Phase::Tokenize);
+            return tokenizer_.tokenize(text, names);
+        }();
+        return parseExpression(tokens);
+    }
+
+    const Expr& Parser::parseExpression(const TokenList& tokens) {
+        CALSCRIPT_PROFILE(profiler_, Profiler::Phase::Parse);
+        return ExpressionParser(calculator_, pool_, tokens).parse();
+    }
+}
\ No newline at end of file
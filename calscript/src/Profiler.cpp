@@ -0,0 +1,105 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace calc {
+    namespace {
+        const char* const PHASE_NAMES[] = {"line", "statement", "tokenize", "parse", "compile", "execute"};
+
+        // Nanoseconds as the fractional microseconds trace events use
+        void writeMicros(std::ostream& out, int64_t nanos) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof buffer, "%.3f", static_cast<double>(nanos) / 1000.0);
+            out << buffer;
+        }
+    }
+
+    void Profiler::start() {
+        open_.clear();
+        spans_.clear();
+        totals_.assign(PHASE_COUNT, Totals{});
+        dropped_ = 0;
+        origin_ = Clock::now();
+        enabled_ = true;
+    }
+
+    void Profiler::begin(uint32_t key) {
+        open_.push_back({key, Clock::now(), 0});
+    }
+
+    void Profiler::end() {
+        // start() inside an open span (prof on twice) forgets the spans already open
+        if (open_.empty()) return;
+
+        Open span = open_.back();
+        open_.pop_back();
+        Clock::time_point now = Clock::now();
+        int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - span.start).count();
+
+        if (span.key >= totals_.size()) totals_.resize(span.key + 1);
+        Totals& totals = totals_[span.key];
+        totals.count++;
+        totals.inclusive += duration;
+        totals.exclusive += duration - span.children;
+        if (!open_.empty()) open_.back().children += duration;
+
+        if (spans_.size() < Constants::MAX_PROFILE_SPANS) {
+            int64_t start = std::chrono::duration_cast<std::chrono::nanoseconds>(span.start - origin_).count();
+            spans_.push_back({span.key, start, duration});
+        } else {
+            dropped_++;
+        }
+    }
+
+    std::string Profiler::keyName(uint32_t key) {
+        if (key < PHASE_COUNT) return PHASE_NAMES[key];
+        return SymbolTable::global().name(key - PHASE_COUNT);
+    }
+
+    void Profiler::writeTrace(std::ostream& out) const {
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        for (size_t i = 0; i < spans_.size(); ++i) {
+            const Span& span = spans_[i];
+            // Phase and function names are identifiers, so nothing needs escaping
+            out << (i > 0 ? ",\n" : "\n") << "{\"name\":\"" << keyName(span.key)
+                << "\",\"cat\":\"" << (span.key < PHASE_COUNT ? "phase" : "function")
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":";
+            writeMicros(out, span.start);
+            out << ",\"dur\":";
+            writeMicros(out, span.duration);
+            out << '}';
+        }
+        out << "\n]}\n";
+    }
+
+    void Profiler::writeTable(std::ostream& out) const {
+        char line[160];
+        std::snprintf(line, sizeof line, "%-24s %10s %14s %14s\n", "", "count", "inclusive ms", "exclusive ms");
+        out << line;
+
+        auto row = [&](const char* kind, uint32_t key) {
+            const Totals& totals = totals_[key];
+            std::snprintf(line, sizeof line, "%-9s %-14s %10llu %14.3f %14.3f\n", kind, keyName(key).c_str(),
+                          static_cast<unsigned long long>(totals.count), totals.inclusive / 1e6, totals.exclusive / 1e6);
+            out << line;
+        };
+
+        for (uint32_t key = 0; key < PHASE_COUNT && key < totals_.size(); ++key) {
+            if (totals_[key].count > 0) row("phase", key);
+        }
+
+        std::vector<uint32_t> functions;
+        for (uint32_t key = PHASE_COUNT; key < totals_.size(); ++key) {
+            if (totals_[key].count > 0) functions.push_back(key);
+        }
+        std::sort(functions.begin(), functions.end(), [this](uint32_t a, uint32_t b) {
+            return totals_[a].exclusive > totals_[b].exclusive;
+        });
+        for (uint32_t key : functions) row("function", key);
+
+        if (dropped_ > 0) {
+            out << dropped_ << " spans after the first " << Constants::MAX_PROFILE_SPANS
+                << " are counted above but not in the trace\n";
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "ScriptRunner.hpp"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace calc {
+    namespace {
+        // Shorter runs of independent lines are not worth handing to the pool
+        constexpr size_t MIN_PARALLEL_LINES = 64;
+        constexpr size_t MIN_CHUNK_LINES = 16;
+        constexpr size_t MAX_CHUNK_LINES = 4096;
+
+        std::string_view trimLine(std::string_view line) {
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            return line;
+        }
+
+        // Output and results of a block of lines evaluated by one worker
+        struct Chunk {
+            size_t first;
+            size_t last;
+            size_t stop;  // lines from here on wait for ans from the chunks before
+
+            std::ostringstream out;
+            std::deque<Calculator::HistoryEntry> history;
+            std::optional<double> lastResult;
+            size_t errors = 0;
+        };
+    }
+
+    ScriptRunner::ScriptRunner(Calculator& calculator, std::ostream& out, size_t jobs)
+        : calculator_(calculator), out_(out) {
+        calculator_.setOutput(out_);
+
+        if (jobs > 1) {
+            pool_ = std::make_unique<ThreadPool>(jobs);
+            for (size_t i = 0; i < jobs; ++i) {
+                workers_.push_back(std::make_unique<Calculator>());
+            }
+        }
+    }
+
+    ScriptRunner::Summary ScriptRunner::run(std::istream& in) {
+        if (pool_) {
+            // The parallel path needs the whole script to find independent lines
+            std::string script(std::istreambuf_iterator<char>(in), {});
+            return run(std::string_view(script));
+        }
+
+        summary_ = Summary{};
+
+        // One buffer reused for every line; output is flushed once at the end, not per result
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!runLine(line)) break;
+        }
+
+        out_.flush();
+        return summary_;
+    }
+
+    ScriptRunner::Summary ScriptRunner::run(std::string_view script) {
+        summary_ = Summary{};
+
+        if (pool_) {
+            runParallel(script);
+            out_.flush();
+            return summary_;
+        }
+
+        while (!script.empty()) {
+            size_t end = script.find('\n');
+            std::string_view line = script.substr(0, end);
+            script.remove_prefix(end == std::string_view::npos ? script.size() : end + 1);
+
+            if (!runLine(line)) break;
+        }
+
+        out_.flush();
+        return summary_;
+    }
+
+    bool ScriptRunner::runLine(std::string_view line) {
+        summary_.lines++;
+        line = trimLine(line);
+
+        if (line == "exit") return false;
+        if (line == "clear") return true;  // no screen to clear in batch mode
+
+        if (!calculator_.processInput(line, summary_.lines)) {
+            summary_.errors++;
+        }
+        return true;
+    }
+
+    void ScriptRunner::runParallel(std::string_view script) {
+        std::vector<std::string_view> lines;
+        while (!script.empty()) {
+            size_t end = script.find('\n');
+            lines.push_back(script.substr(0, end));
+            script.remove_prefix(end == std::string_view::npos ? script.size() : end + 1);
+        }
+
+        size_t i = 0;
+        while (i < lines.size()) {
+            // Only keywords are checked here; lines that turn out to read ans are handed back
+            // by the workers (see runIndependent)
+            size_t last = i;
+            while (last < lines.size()) {
+                std::string_view line = trimLine(lines[last]);
+                if (line == "exit" || !calculator_.isIndependent(line)) break;
+                last++;
+            }
+
+            // A profile records one calculator, so lines stay on it while profiling
+            if (last - i >= MIN_PARALLEL_LINES && !calculator_.isProfiling()) {
+                runIndependent(lines, i, last);
+                i = last;
+                continue;
+            }
+
+            // Short run, or a stateful line: evaluate in order on the main calculator
+            size_t stop = std::max(last, i + 1);
+            for (; i < stop; ++i) {
+                if (!runLine(lines[i])) return;
+            }
+        }
+    }
+
+    void ScriptRunner::runIndependent(const std::vector<std::string_view>& lines, size_t first, size_t last) {
+        size_t count = last - first;
+        size_t chunkLines = std::clamp(count / (pool_->size() * 8), MIN_CHUNK_LINES, MAX_CHUNK_LINES);
+
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        for (size_t start = first; start < last; start += chunkLines) {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->first = start;
+            chunk->last = std::min(start + chunkLines, last);
+            chunk->stop = chunk->last;
+            chunks.push_back(std::move(chunk));
+        }
+
+        // Workers start from the main calculator's current definitions
+        // (char, not bool: each worker writes its own element concurrently)
+        std::vector<char> synced(workers_.size(), false);
+        double ans = calculator_.getLastResult();
+
+        for (auto& chunkPtr : chunks) {
+            Chunk* chunk = chunkPtr.get();
+            pool_->submit([this, &lines, &synced, ans, first, chunk](size_t worker) {
+                Calculator& calculator = *workers_[worker];
+                if (!synced[worker]) {
+                    calculator.copyStateFrom(calculator_);
+                    synced[worker] = true;
+                }
+
+                calculator.setOutput(chunk->out);
+                calculator.clearHistory();
+                // Only the first chunk knows ans; later ones learn it from their own lines
+                if (chunk->first == first) {
+                    calculator.setLastResult(ans);
+                } else {
+                    calculator.forgetLastResult();
+                }
+
+                for (size_t i = chunk->first; i < chunk->last; ++i) {
+                    std::string_view line = trimLine(lines[i]);
+                    if (line == "clear") continue;
+
+                    if (!calculator.processInput(line, i + 1)) {
+                        chunk->errors++;
+                    }
+                    if (calculator.skippedForAns()) {
+                        chunk->stop = i;
+                        break;
+                    }
+                    // A line that records nothing leaves the previous entry at the back
+                    const auto& history = calculator.getHistory();
+                    if (!history.empty() && history.back().result) {
+                        chunk->lastResult = history.back().result;
+                    }
+                }
+                chunk->history = calculator.getHistory();
+            });
+        }
+        pool_->wait();
+
+        // Merge in script order, as if the main calculator had run every line
+        for (const auto& chunk : chunks) {
+            out_ << chunk->out.str();
+            for (const auto& entry : chunk->history) {
+                calculator_.appendHistory(entry);
+            }
+            if (chunk->lastResult) {
+                calculator_.setLastResult(*chunk->lastResult);
+            }
+            summary_.errors += chunk->errors;
+            summary_.lines += chunk->stop - chunk->first;
+
+            // The rest of the chunk read ans before any line in it set it; it is known now
+            for (size_t i = chunk->stop; i < chunk->last; ++i) {
+                runLine(lines[i]);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include "Server.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+
+#ifdef __linux__
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace calc {
+    namespace {
+        constexpr size_t READ_SIZE = 64 * 1024;
+        constexpr size_t MAX_LINE = 64 * 1024;           // longer lines are refused and the connection closed
+        constexpr size_t MAX_PENDING_OUTPUT = 4 << 20;  // stop reading from a client that does not read its results
+        constexpr int MAX_EVENTS = 64;
+
+        // Appends everything written to a string
+        class StringBuffer : public std::streambuf {
+            public:
+                explicit StringBuffer(std::string& target) : target_(target) {}
+
+            protected:
+                int_type overflow(int_type c) override {
+                    if (!traits_type::eq_int_type(c, traits_type::eof())) target_ += traits_type::to_char_type(c);
+                    return traits_type::not_eof(c);
+                }
+                std::streamsize xsputn(const char* s, std::streamsize n) override {
+                    target_.append(s, static_cast<size_t>(n));
+                    return n;
+                }
+
+            private:
+                std::string& target_;
+        };
+
+        std::string systemError(const std::string& what) {
+            return what + ": " + std::strerror(errno);
+        }
+    }
+
+    struct Server::Connection {
+        // Any local user can connect, so sessions may not touch files with the server's privileges
+        explicit Connection(int fd) : fd(fd) {
+            session.setOutput(stream);
+            session.setFileAccess(false);
+        }
+
+        int fd;
+        Calculator session;
+        std::string input;    // received bytes not yet run (at most a partial line between reads)
+        std::string output;   // responses not yet sent
+        size_t sent = 0;      // bytes at the front of output already sent
+        std::string printed;  // what the current line printed
+        StringBuffer buffer{printed};
+        std::ostream stream{&buffer};
+        uint32_t events = 0;  // registered with epoll
+        bool closing = false; // exit, end of input or a refused line: close once output is sent
+    };
+
+#ifdef __linux__
+    Server::Server(const Calculator& prototype, Options options)
+        : prototype_(prototype), options_(std::move(options)) {
+        try {
+            epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_ < 0) throw CalcError(systemError("epoll_create1"));
+            wake_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (wake_ < 0) throw CalcError(systemError("eventfd"));
+            watch(wake_, EPOLLIN);
+
+            listenUnix();
+            if (options_.port >= 0) listenTcp();
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    Server::~Server() {
+        release();
+    }
+
+    void Server::release() {
+        for (auto& connection : connections_) {
+            if (connection) ::close(connection->fd);
+        }
+        connections_.clear();
+        if (unixListener_ >= 0) {
+            ::close(unixListener_);
+            ::unlink(options_.socketPath.c_str());
+            unixListener_ = -1;
+        }
+        for (int* fd : {&tcpListener_, &wake_, &epoll_}) {
+            if (*fd >= 0) ::close(*fd);
+            *fd = -1;
+        }
+    }
+
+    void Server::listenUnix() {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        const std::string& path = options_.socketPath;
+        if (path.empty() || path.size() >= sizeof address.sun_path) {
+            throw CalcError("Invalid socket path: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        // A socket left behind by a server that died is replaced; a live one is not
+        struct stat info;
+        if (::lstat(path.c_str(), &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) throw CalcError(path + " exists and is not a socket");
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool live = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0;
+            if (probe >= 0) ::close(probe);
+            if (live) throw CalcError(path + " is in use by another server");
+            ::unlink(path.c_str());
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw CalcError(systemError("socket"));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+            std::string error = systemError("Cannot bind " + path);
+            ::close(fd);
+            throw CalcError(error);
+        }
+        unixListener_ = fd;  // from here on the destructor removes the socket file
+        if (::listen(fd, SOMAXCONN) != 0) throw CalcError(systemError("listen"));
+        watch(fd, EPOLLIN);
+    }
+
+    void Server::listenTcp() {
+        if (options_.port > 65535) throw CalcError("Invalid port: " + std::to_string(options_.port));
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw CalcError(systemError("socket"));
+        tcpListener_ = fd;
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+        // Loopback only: sessions can define functions and run any computation, which is still
+        // more than remote clients should get (file commands are refused for every session)
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(options_.port));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+            throw CalcError(systemError("Cannot bind 127.0.0.1:" + std::to_string(options_.port)));
+        }
+        if (::listen(fd, SOMAXCONN) != 0) throw CalcError(systemError("listen"));
+
+        socklen_t length = sizeof address;
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+        port_ = ntohs(address.sin_port);
+        watch(fd, EPOLLIN);
+    }
+
+    void Server::watch(int fd, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) throw CalcError(systemError("epoll_ctl"));
+    }
+
+    void Server::run() {
+        epoll_event events[MAX_EVENTS];
+        bool stopping = false;
+
+        while (!stopping) {
+            int count = ::epoll_wait(epoll_, events, MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                throw CalcError(systemError("epoll_wait"));
+            }
+
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wake_) {
+                    stopping = true;
+                } else if (fd == unixListener_ || fd == tcpListener_) {
+                    accept(fd);
+                } else if (static_cast<size_t>(fd) < connections_.size() && connections_[fd]) {
+                    Connection& connection = *connections_[fd];
+                    uint32_t ready = events[i].events;
+                    if (ready & EPOLLIN) {
+                        receive(connection);
+                    } else if (ready & (EPOLLERR | EPOLLHUP)) {
+                        close(fd);
+                        continue;
+                    }
+                    if (connections_[fd]) send(connection);
+                }
+            }
+        }
+
+        for (size_t fd = 0; fd < connections_.size(); ++fd) {
+            if (connections_[fd]) close(static_cast<int>(fd));
+        }
+    }
+
+    void Server::stop() {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(wake_, &one, sizeof one);
+    }
+
+    void Server::accept(int listener) {
+        // The listener is level-triggered, so connections beyond this batch are picked up next time
+        for (int i = 0; i < MAX_EVENTS; ++i) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;  // EAGAIN, or the client gave up before being accepted
+
+            if (listener == tcpListener_) {
+                int on = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+            }
+
+            auto connection = std::make_unique<Connection>(fd);
+            connection->session.copyStateFrom(prototype_);
+            connection->events = EPOLLIN;
+            if (static_cast<size_t>(fd) >= connections_.size()) connections_.resize(fd + 1);
+            connections_[fd] = std::move(connection);
+            try {
+                watch(fd, EPOLLIN);
+            } catch (const CalcError&) {
+                ::close(fd);
+                connections_[fd].reset();
+            }
+        }
+    }
+
+    void Server::receive(Connection& connection) {
+        char data[READ_SIZE];
+        ssize_t count = ::read(connection.fd, data, sizeof data);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EINTR) close(connection.fd);
+            return;
+        }
+        if (count == 0) {
+            // End of input: a last line without a newline still runs
+            connection.closing = true;
+            if (!connection.input.empty()) {
+                std::string line = std::move(connection.input);
+                connection.input.clear();
+                runLine(connection, line);
+            }
+            return;
+        }
+
+        connection.input.append(data, static_cast<size_t>(count));
+        runLines(connection);
+    }
+
+    void Server::runLines(Connection& connection) {
+        std::string_view pending = connection.input;
+        size_t end;
+        while (!connection.closing && (end = pending.find('\n')) != std::string_view::npos) {
+            runLine(connection, pending.substr(0, end));
+            pending.remove_prefix(end + 1);
+        }
+
+        if (connection.closing) {
+            connection.input.clear();
+        } else if (pending.size() > MAX_LINE) {
+            connection.output += "err 1\nError: Line too long\n";
+            connection.closing = true;
+            connection.input.clear();
+        } else {
+            connection.input.erase(0, connection.input.size() - pending.size());
+        }
+    }
+
+    void Server::runLine(Connection& connection, std::string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line == "exit") {
+            connection.closing = true;
+            return;
+        }
+
+        connection.printed.clear();
+        bool ok = line == "clear" || connection.session.processInput(line);
+        size_t lines = static_cast<size_t>(std::count(connection.printed.begin(), connection.printed.end(), '\n'));
+        connection.output += ok ? "ok " : "err ";
+        connection.output += std::to_string(lines);
+        connection.output += '\n';
+        connection.output += connection.printed;
+    }
+
+    void Server::send(Connection& connection) {
+        while (connection.sent < connection.output.size()) {
+            ssize_t count = ::send(connection.fd, connection.output.data() + connection.sent,
+                                   connection.output.size() - connection.sent, MSG_NOSIGNAL);
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EINTR) break;
+                close(connection.fd);
+                return;
+            }
+            connection.sent += static_cast<size_t>(count);
+        }
+        if (connection.sent == connection.output.size()) {
+            connection.output.clear();
+            connection.sent = 0;
+            if (connection.closing) {
+                close(connection.fd);
+                return;
+            }
+        }
+        update(connection);
+    }
+
+    // Waits for output space only while output is queued, and for input only while the
+    // client keeps up with its results
+    void Server::update(Connection& connection) {
+        size_t pending = connection.output.size() - connection.sent;
+        uint32_t events = 0;
+        if (!connection.closing && pending < MAX_PENDING_OUTPUT) events |= EPOLLIN;
+        if (pending > 0) events |= EPOLLOUT;
+        if (events == connection.events) return;
+
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = connection.fd;
+        ::epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+
+    void Server::close(int fd) {
+        ::epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        connections_[fd].reset();
+    }
+#else
+    Server::Server(const Calculator& prototype, Options options)
+        : prototype_(prototype), options_(std::move(options)) {
+        throw CalcError("Server mode is only available on Linux");
+    }
+
+    Server::~Server() = default;
+
+    void Server::release() {}
+
+    void Server::run() {}
+
+    void Server::stop() {}
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "SharedCalculator.hpp"
+
+namespace calc {
+    SharedCalculator::SharedCalculator() {
+        publish();
+    }
+
+    SharedCalculator::~SharedCalculator() {
+        delete current_.load(std::memory_order_relaxed);
+    }
+
+    bool SharedCalculator::update(std::string_view input, std::ostream& out) {
+        std::lock_guard<std::mutex> lock(updateMutex_);
+        writer_.setOutput(out);
+        bool ok = writer_.processInput(input);
+        publish();
+        return ok;
+    }
+
+    // Writers only (updateMutex_ held, or the constructor)
+    void SharedCalculator::publish() {
+        uint64_t version = version_.load(std::memory_order_relaxed) + 1;
+        auto* snapshot = new Snapshot{version, {}};
+        snapshot->state.copyStateFrom(writer_);
+
+        const Snapshot* previous = current_.exchange(snapshot, std::memory_order_acq_rel);
+        // Readers check the version first, so the snapshot must be in place before it moves
+        version_.store(version, std::memory_order_release);
+        if (previous) epochs_.retire([previous] { delete previous; });
+    }
+
+    SharedCalculator::Reader::Reader(SharedCalculator& shared) : shared_(shared), epochReader_(shared.epochs_) {}
+
+    // Moves to the current version's tables. The guard keeps that version allocated while
+    // its tables are referenced, even if an update replaces it meanwhile.
+    void SharedCalculator::Reader::refresh() {
+        if (shared_.version_.load(std::memory_order_acquire) == version_) return;
+
+        EpochDomain::Guard guard(epochReader_);
+        const Snapshot* snapshot = shared_.current_.load(std::memory_order_acquire);
+        calculator_.copyStateFrom(snapshot->state);
+        version_ = snapshot->version;
+    }
+
+    double SharedCalculator::Reader::evaluate(std::string_view expression) {
+        refresh();
+        return calculator_.evaluate(expression);
+    }
+
+    double SharedCalculator::Reader::callFunction(const std::string& name, const std::vector<double>& args) {
+        refresh();
+        return calculator_.callFunction(name, args);
+    }
+}
\ No newline at end of file
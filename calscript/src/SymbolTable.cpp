@@ -0,0 +1,133 @@
+#include "SymbolTable.hpp"
+#include "Constants.hpp"
+#include <functional>
+#include <stdexcept>
+
+namespace calc {
+    namespace {
+        // Spelling of each builtin, indexed by SymbolTable::Builtin
+        const char* const BUILTIN_NAMES[SymbolTable::BuiltinCount] = {
+            "pi", "e", "phi", "sqrt2",
+            "ans",
+            "sin", "cos", "tan", "log", "ln", "sqrt",
+            "true", "false",
+            "def", "del", "upd", "ls", "create", "use", "memo", "formula", "save", "load", "jit", "prof"
+        };
+    }
+
+    const SymbolTable::Info SymbolTable::BUILTINS[SymbolTable::BuiltinCount] = {
+        {Kind::Constant, Constants::PI},
+        {Kind::Constant, Constants::E},
+        {Kind::Constant, Constants::PHI},
+        {Kind::Constant, Constants::SQRT2},
+        {Kind::PrevResult, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::MathFunction, 0.0},
+        {Kind::Boolean, 1.0},
+        {Kind::Boolean, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0},
+        {Kind::Command, 0.0}
+    };
+
+    SymbolTable& SymbolTable::global() {
+        static SymbolTable table;
+        return table;
+    }
+
+    SymbolTable::Tables::Tables(size_t capacity)
+        : capacity(capacity),
+          index(new std::atomic<const Entry*>[capacity]),
+          byId(new std::atomic<const Entry*>[capacity / 2]) {
+        for (size_t i = 0; i < capacity; ++i) index[i].store(nullptr, std::memory_order_relaxed);
+        for (size_t i = 0; i < capacity / 2; ++i) byId[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    SymbolTable::SymbolTable() : tables_(new Tables(256)) {
+        for (const char* name : BUILTIN_NAMES) {
+            intern(name);
+        }
+    }
+
+    SymbolTable::~SymbolTable() {
+        delete tables_.load(std::memory_order_relaxed);
+    }
+
+    size_t SymbolTable::hash(std::string_view name) {
+        return std::hash<std::string_view>{}(name);
+    }
+
+    // One registration per thread, kept for the thread's lifetime
+    EpochDomain::Reader& SymbolTable::reader() const {
+        thread_local EpochDomain::Reader reader(epochs_);
+        return reader;
+    }
+
+    const SymbolTable::Entry* SymbolTable::find(const Tables& tables, std::string_view name) const {
+        size_t mask = tables.capacity - 1;
+        for (size_t i = hash(name) & mask;; i = (i + 1) & mask) {
+            const Entry* entry = tables.index[i].load(std::memory_order_acquire);
+            if (!entry || entry->name == name) return entry;
+        }
+    }
+
+    // Writers only (mutex_ held); the entry is visible by id before it can be found by name
+    void SymbolTable::insert(Tables& tables, const Entry& entry) {
+        tables.byId[entry.id].store(&entry, std::memory_order_release);
+        size_t mask = tables.capacity - 1;
+        size_t i = hash(entry.name) & mask;
+        while (tables.index[i].load(std::memory_order_relaxed)) i = (i + 1) & mask;
+        tables.index[i].store(&entry, std::memory_order_release);
+    }
+
+    SymbolId SymbolTable::intern(std::string_view name) {
+        if (auto id = lookup(name)) return *id;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Tables* tables = tables_.load(std::memory_order_relaxed);
+        if (const Entry* entry = find(*tables, name)) return entry->id;
+
+        SymbolId id = static_cast<SymbolId>(entries_.size());
+        entries_.push_back({std::string(name), id});
+        const Entry& entry = entries_.back();
+        if (id >= tables->capacity / 2) {
+            // Full: readers move to twice the size while lookups already inside keep the old one
+            auto* grown = new Tables(tables->capacity * 2);
+            for (const Entry& existing : entries_) insert(*grown, existing);
+            tables_.store(grown, std::memory_order_release);
+            epochs_.retire([tables] { delete tables; });
+        } else {
+            insert(*tables, entry);
+        }
+        return id;
+    }
+
+    std::optional<SymbolId> SymbolTable::lookup(std::string_view name) const {
+        EpochDomain::Guard guard(reader());
+        const Entry* entry = find(*tables_.load(std::memory_order_acquire), name);
+        if (!entry) return std::nullopt;
+        return entry->id;
+    }
+
+    const std::string& SymbolTable::name(SymbolId id) const {
+        EpochDomain::Guard guard(reader());
+        const Tables& tables = *tables_.load(std::memory_order_acquire);
+        const Entry* entry = id < tables.capacity / 2 ? tables.byId[id].load(std::memory_order_acquire) : nullptr;
+        if (!entry) throw std::out_of_range("Unknown symbol id " + std::to_string(id));
+        // Entries never move or go away, so the name outlives the guard
+        return entry->name;
+    }
+}
\ No newline at end of file
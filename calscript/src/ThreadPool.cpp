@@ -0,0 +1,106 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+namespace calc {
+    ThreadPool::ThreadPool(size_t threads) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; ++i) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::submit(Task task) {
+        size_t target;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            target = next_++ % queues_.size();
+            pending_++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+            queues_[target]->tasks.push_back(std::move(task));
+        }
+        {
+            // Published under mutex_ so a worker checking for work cannot miss it
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_++;
+        }
+        wake_.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool ThreadPool::takeTask(size_t worker, Task& task) {
+        // Own queue first, newest task (its data is most likely still in cache)
+        {
+            Queue& own = *queues_[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued_--;
+                return true;
+            }
+        }
+
+        // Otherwise steal the oldest task from the other workers
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            Queue& victim = *queues_[(worker + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::workerLoop(size_t worker) {
+        Task task;
+        while (true) {
+            if (takeTask(worker, task)) {
+                std::exception_ptr error;
+                try {
+                    task(worker);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                task = nullptr;
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (error && !error_) error_ = error;
+                if (--pending_ == 0) done_.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+            if (stopping_ && queued_ == 0) return;
+        }
+    }
+}
\ No newline at end of file
@@ -2,13 +2,38 @@
 #include "Constants.hpp"
 #include <cctype>
 #include <algorithm>
+#include <charconv>
+#include <memory>
 
 namespace calc {
-    std::vector<Token> TokenProcessor::tokenize(std::string_view expression) {
-        std::vector<Token> tokens;
-        tokens.reserve(expression.length() / 2);
-        auto& pool = getTokenPool();
-        pool.reset();
+    static_assert(SymbolTable::Sqrt - SymbolTable::Sin ==
+                  static_cast<SymbolId>(Operator::Sqrt) - static_cast<SymbolId>(Operator::Sin),
+                  "math function symbols and operators must line up");
+
+    namespace {
+        constexpr size_t INITIAL_TOKENS = 64;  // covers most lines without growing
+    }
+
+    TokenList TokenProcessor::tokenize(std::string_view expression, Names names) {
+        // A character produces at most two tokens (itself and an implicit '*'). Short lines get
+        // that many slots at once; longer ones start smaller and double the array when it
+        // fills, so a line holds at most about twice the arena its tokens need (arrays it
+        // outgrew are released with the rest when the Scope ends)
+        size_t capacity = std::min(expression.length() * 2 + 1, INITIAL_TOKENS);
+        Token* tokens = pool_.allocateArray(capacity);
+        size_t count = 0;
+        auto push = [&](Token token) {
+            if (count == capacity) {
+                Token* grown = pool_.allocateArray(capacity * 2);
+                std::uninitialized_copy_n(tokens, count, grown);
+                tokens = grown;
+                capacity *= 2;
+            }
+            new (&tokens[count++]) Token(token);
+        };
+        auto last = [&]() -> const Token& { return tokens[count - 1]; };
+
+        auto pushImplicitMul = [&]() { push(Token(Token::Type::Operator, "*", Operator::Mul)); };
     
         std::string_view remaining = expression;
         bool expectingValue = true;  // Determines if we expect a value (true) or operator (false)
@@ -23,7 +48,7 @@ namespace calc {
             
             // Handle comma for function parameters
             if (c == ',') {
-                tokens.push_back(*pool.allocate(Token::Type::Comma, ","));
+                push(Token(Token::Type::Comma, ","));
                 expectingValue = true;
                 remaining.remove_prefix(1);
                 continue;
@@ -31,7 +56,7 @@ namespace calc {
             
             // Handle colon for function definition
             if (c == ':') {
-                tokens.push_back(*pool.allocate(Token::Type::Colon, ":"));
+                push(Token(Token::Type::Colon, ":"));
                 expectingValue = true;
                 remaining.remove_prefix(1);
                 continue;
@@ -44,21 +69,18 @@ namespace calc {
                     peek_idx++; 
                 }
     
-                std::string word(remaining.substr(0, peek_idx));
-                std::transform(word.begin(), word.end(), word.begin(), ::tolower);
-    
                 // If not a command, check for implicit multiplication
-                if (!tokens.empty() && !expectingValue && 
-                    (tokens.back().getType() == Token::Type::Number || 
-                     tokens.back().getType() == Token::Type::Variable || 
-                     tokens.back().getType() == Token::Type::Constant || 
-                     tokens.back().getType() == Token::Type::PrevResult || 
-                     tokens.back().getValue() == ")" || 
-                     tokens.back().getValue() == "!")) {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "*"));
+                if (count > 0 && !expectingValue && 
+                    (last().getType() == Token::Type::Number || 
+                     last().getType() == Token::Type::Variable || 
+                     last().getType() == Token::Type::Constant || 
+                     last().getType() == Token::Type::PrevResult || 
+                     last().getValue() == ")" || 
+                     last().getValue() == "!")) {
+                    pushImplicitMul();
                 }
     
-                handleWord(remaining, tokens);
+                push(handleWord(remaining, names));
                 expectingValue = false;
                 continue;
             }
@@ -70,27 +92,17 @@ namespace calc {
                 if (expectingValue) {
                     // Check if it's a negative number
                     if (!remaining.empty() && std::isdigit(remaining.front())) {
-                        size_t idx = 0;
-                        bool hasDecimal = false;
-                        
-                        while (idx < remaining.length() && 
-                               (std::isdigit(remaining[idx]) || (!hasDecimal && remaining[idx] == '.'))) {
-                            if (remaining[idx] == '.') hasDecimal = true;
-                            idx++;
-                        }
-                        
-                        if (idx > 0) {
-                            std::string number = "-" + std::string(remaining.substr(0, idx));
-                            remaining.remove_prefix(idx);
-                            tokens.push_back(*pool.allocate(Token::Type::Number, number));
-                            expectingValue = false;
-                            continue;
-                        }
+                        // The '-' directly precedes the digits, so the literal is one slice of the input
+                        std::string_view number(remaining.data() - 1, scanNumber(remaining) + 1);
+                        remaining.remove_prefix(number.length() - 1);
+                        push(numberToken(number));
+                        expectingValue = false;
+                        continue;
                     }
                     
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "neg")); // Unary negation
+                    push(Token(Token::Type::Operator, "-", Operator::Neg)); // Unary negation
                 } else {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "-")); // Subtraction
+                    push(Token(Token::Type::Operator, "-", Operator::Sub)); // Subtraction
                     expectingValue = true;
                 }
                 continue;
@@ -98,21 +110,21 @@ namespace calc {
     
             // Handle numbers with implicit multiplication
             if (auto numToken = parseNumber(remaining)) {
-                if (!tokens.empty() && !expectingValue &&
-                    (tokens.back().getType() == Token::Type::Variable || 
-                     tokens.back().getType() == Token::Type::Constant || 
-                     tokens.back().getType() == Token::Type::PrevResult || 
-                     tokens.back().getValue() == ")" || 
-                     tokens.back().getValue() == "!")) {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "*"));
+                if (count > 0 && !expectingValue &&
+                    (last().getType() == Token::Type::Variable || 
+                     last().getType() == Token::Type::Constant || 
+                     last().getType() == Token::Type::PrevResult || 
+                     last().getValue() == ")" || 
+                     last().getValue() == "!")) {
+                    pushImplicitMul();
                 }
     
-                tokens.push_back(*numToken);
+                push(*numToken);
                 expectingValue = false;
     
                 // If a number is followed by a variable, function, or `(`
                 if (!remaining.empty() && (std::isalpha(remaining.front()) || remaining.front() == '(')) {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "*"));
+                    pushImplicitMul();
                     expectingValue = true;
                 }
     
@@ -121,7 +133,7 @@ namespace calc {
     
             // Handle operators (excluding '-')
             if (isOperator(c) && c != '-') {
-                tokens.push_back(*pool.allocate(Token::Type::Operator, std::string(1, c)));
+                push(Token(Token::Type::Operator, remaining.substr(0, 1), operatorFor(c)));
                 expectingValue = true;
                 remaining.remove_prefix(1);
     
@@ -129,25 +141,26 @@ namespace calc {
                 if (c == '!' && !remaining.empty() && 
                     (std::isalpha(remaining.front()) || std::isdigit(remaining.front()) || 
                      remaining.front() == '(' || remaining.front() == '.')) {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "*"));
+                    pushImplicitMul();
                     expectingValue = true;
                 }
                 continue;
             }
     
             // Handle brackets with implicit multiplication
+            // (a variable followed by '(' is left to the compiler, which knows if it names a function)
             if (c == '(' || c == ')') {
-                if (c == '(' && !tokens.empty() && !expectingValue &&
-                    (tokens.back().getType() == Token::Type::Number || 
-                     tokens.back().getType() == Token::Type::Constant || 
-                     tokens.back().getType() == Token::Type::Variable || 
-                     tokens.back().getType() == Token::Type::PrevResult || 
-                     tokens.back().getValue() == "!" || 
-                     tokens.back().getValue() == ")")) {
-                    tokens.push_back(*pool.allocate(Token::Type::Operator, "*"));
+                if (c == '(' && count > 0 && !expectingValue &&
+                    (last().getType() == Token::Type::Number ||
+                     last().getType() == Token::Type::Constant ||
+                     last().getType() == Token::Type::PrevResult ||
+                     last().getValue() == "!" || 
+                     last().getValue() == ")")) {
+                    pushImplicitMul();
                 }
     
-                tokens.push_back(*pool.allocate(Token::Type::Bracket, std::string(1, c)));
+                push(Token(Token::Type::Bracket, remaining.substr(0, 1),
+                           c == '(' ? Operator::LeftParen : Operator::RightParen));
                 expectingValue = (c == '(');
                 remaining.remove_prefix(1);
                 continue;
@@ -160,10 +173,13 @@ namespace calc {
             remaining.remove_prefix(1);
         }
     
-        return tokens;
+        return TokenList(tokens, count);
     }
     
-    std::optional<Token> TokenProcessor::parseNumber(std::string_view& input) {
+    // Length of the decimal literal at the start of input (digits with at most one '.', then
+    // an optional exponent), or 0. The exponent is only taken when digits follow it, so
+    // 2e and 2e(1) still mean 2 * e.
+    size_t TokenProcessor::scanNumber(std::string_view input) {
         size_t idx = 0;
         bool hasDecimal = false;
 
@@ -172,56 +188,114 @@ namespace calc {
             if (input[idx] == '.') hasDecimal = true;
             idx++;
         }
+        if (idx == 0) return 0;
 
-        if (idx == 0) {
+        if (idx < input.length() && (input[idx] == 'e' || input[idx] == 'E')) {
+            size_t exponent = idx + 1;
+            if (exponent < input.length() && (input[exponent] == '+' || input[exponent] == '-')) exponent++;
+            if (exponent < input.length() && std::isdigit(input[exponent])) {
+                idx = exponent;
+                while (idx < input.length() && std::isdigit(input[idx])) idx++;
+            }
+        }
+        return idx;
+    }
+
+    // Locale-independent conversion of a literal found by scanNumber, with an optional
+    // leading '-'; nullopt if it is malformed ('.') or does not fit in a double
+    std::optional<double> TokenProcessor::convertNumber(std::string_view text) {
+        double value = 0.0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.length(), value);
+        if (error != std::errc() || end != text.data() + text.length()) return std::nullopt;
+        return value;
+    }
+
+    std::optional<Token> TokenProcessor::parseNumber(std::string_view& input) {
+        size_t length = scanNumber(input);
+        if (length == 0) {
             return std::nullopt;
         }
 
-        std::string number(input.substr(0, idx));
-        input.remove_prefix(idx);
-        return *getTokenPool().allocate(Token::Type::Number, std::move(number));
+        std::string_view number = input.substr(0, length);
+        input.remove_prefix(length);
+        return numberToken(number);
+    }
+
+    Token TokenProcessor::numberToken(std::string_view text) {
+        auto value = convertNumber(text);
+        if (!value) {
+            // A lone '.' is the only malformed literal scanNumber accepts
+            bool hasDigit = std::any_of(text.begin(), text.end(), [](char c) { return std::isdigit(c); });
+            throw CalcError((hasDigit ? "Number out of range: " : "Invalid number: ") + std::string(text));
+        }
+        return Token(text, *value);
+    }
+
+    std::optional<double> TokenProcessor::parseLiteral(std::string_view text) {
+        if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+        size_t sign = (!text.empty() && text.front() == '-') ? 1 : 0;
+        if (text.length() == sign || scanNumber(text.substr(sign)) != text.length() - sign) {
+            return std::nullopt;
+        }
+        return convertNumber(text);
     }
 
-    void TokenProcessor::handleWord(std::string_view& input, std::vector<Token>& tokens) {
+    Token TokenProcessor::handleWord(std::string_view& input, Names names) {
         size_t idx = 0;
-        auto& pool = getTokenPool();
-        
+
         while (idx < input.length() && (std::isalnum(input[idx]) || input[idx] == '_')) {
             idx++;
         }
 
-        std::string word(input.substr(0, idx));
-        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+        // Names are case-insensitive; only words with capitals need a lowercased copy
+        std::string_view word = input.substr(0, idx);
+        input.remove_prefix(idx);
 
-        Token::Type type;
-        
-        // Check for commands first
-        if (word == "def" || word == "del" || word == "upd" || word == "ls") {
-            type = Token::Type::Command;
-        }
-        // Check if it's a function-related command
-        else if (word == "create" || word == "use") {
-            type = Token::Type::Command;
-        }
-        else if (word == "pi" || word == "e" || word == "phi" || word == "sqrt2") {
-            type = Token::Type::Constant;
-        }
-        else if (word == "ans") {
-            type = Token::Type::PrevResult;
-        }
-        else if (word == "sin" || word == "cos" || word == "tan" || 
-                 word == "log" || word == "ln" || word == "sqrt") {
-            type = Token::Type::MathFunction;
+        std::string_view name = word;
+        if (std::any_of(word.begin(), word.end(), [](char c) { return std::isupper(c); })) {
+            lowered_.assign(word);
+            std::transform(lowered_.begin(), lowered_.end(), lowered_.begin(), ::tolower);
+            name = lowered_;
         }
-        else if (word == "true" || word == "false") {
-            type = Token::Type::Boolean;
-        }
-        else {
-            type = Token::Type::Variable;
+
+        SymbolTable& symbols = SymbolTable::global();
+        std::optional<SymbolId> found = names == Names::Intern ? symbols.intern(name) : symbols.lookup(name);
+        // Not a name anywhere yet: the token keeps the text as written
+        if (!found) return Token(Token::Type::Variable, word);
+        SymbolId symbol = *found;
+
+        // Builtin names have fixed ids, so classifying a word is a single table lookup
+        Token::Type type;
+        Operator op = Operator::None;
+
+        switch (SymbolTable::info(symbol).kind) {
+            case SymbolTable::Kind::Command:      type = Token::Type::Command; break;
+            case SymbolTable::Kind::Constant:     type = Token::Type::Constant; break;
+            case SymbolTable::Kind::PrevResult:   type = Token::Type::PrevResult; break;
+            case SymbolTable::Kind::MathFunction:
+                type = Token::Type::MathFunction;
+                // Math function ids are consecutive, in the same order as their operators
+                op = static_cast<Operator>(static_cast<SymbolId>(Operator::Sin) + (symbol - SymbolTable::Sin));
+                break;
+            case SymbolTable::Kind::Boolean:      type = Token::Type::Boolean; break;
+            default:                              type = Token::Type::Variable; break;
         }
 
-        tokens.push_back(*pool.allocate(type, std::move(word)));
-        input.remove_prefix(idx);
+        // The token refers to the interned spelling, which lives as long as the symbol table
+        return Token(type, symbols.name(symbol), symbol, op);
+    }
+
+    Operator TokenProcessor::operatorFor(char c) {
+        switch (c) {
+            case '+': return Operator::Add;
+            case '-': return Operator::Sub;
+            case '*': return Operator::Mul;
+            case '/': return Operator::Div;
+            case '%': return Operator::Mod;
+            case '^': return Operator::Pow;
+            case '!': return Operator::Factorial;
+            default:  return Operator::None;
+        }
     }
 
     bool TokenProcessor::isOperator(char c) {
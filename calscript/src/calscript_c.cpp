@@ -0,0 +1,70 @@
+#include "calscript_c.h"
+#include "Expression.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <new>
+
+struct calscript_expr {
+    calc::Expression expression;
+};
+
+namespace {
+    // Copies as much of message as fits, always NUL-terminated
+    void reportError(const char* message, char* error, size_t errorSize) {
+        if (error == nullptr || errorSize == 0) return;
+        size_t length = std::min(std::strlen(message), errorSize - 1);
+        std::memcpy(error, message, length);
+        error[length] = '\0';
+    }
+}
+
+// No exception may cross into C: each entry point reports errors through its return value
+extern "C" {
+    calscript_expr* calscript_compile(const char* source, char* error, size_t error_size) {
+        if (source == nullptr) {
+            reportError("No expression given", error, error_size);
+            return nullptr;
+        }
+        try {
+            return new calscript_expr{calc::Expression::compile(source)};
+        } catch (const std::bad_alloc&) {
+            reportError("Out of memory", error, error_size);
+        } catch (const std::exception& e) {
+            reportError(e.what(), error, error_size);
+        }
+        return nullptr;
+    }
+
+    void calscript_free(calscript_expr* expr) {
+        delete expr;
+    }
+
+    size_t calscript_variable_count(const calscript_expr* expr) {
+        return expr ? expr->expression.getVariables().size() : 0;
+    }
+
+    const char* calscript_variable_name(const calscript_expr* expr, size_t index) {
+        if (expr == nullptr || index >= expr->expression.getVariables().size()) return nullptr;
+        return expr->expression.getVariables()[index].c_str();
+    }
+
+    int calscript_eval(const calscript_expr* expr, const double* values, size_t count, double* result,
+                       char* error, size_t error_size) {
+        if (expr == nullptr || result == nullptr) {
+            reportError("No expression given", error, error_size);
+            return 1;
+        }
+        if (count != expr->expression.getVariables().size() || (count > 0 && values == nullptr)) {
+            reportError("Wrong number of values for the expression's variables", error, error_size);
+            return 1;
+        }
+        try {
+            *result = expr->expression.eval(values);
+            return 0;
+        } catch (const std::exception& e) {
+            reportError(e.what(), error, error_size);
+            return 1;
+        }
+    }
+}
\ No newline at end of file
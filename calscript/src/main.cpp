@@ -1,11 +1,161 @@
 #include "Calculator.hpp"
 #include "Constants.hpp"
+#include "ScriptRunner.hpp"
+#include "MappedFile.hpp"
+#include "Server.hpp"
+#include <csignal>
 #include <iostream>
 #include <string>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+    #include <io.h>
+    #define CALSCRIPT_ISATTY(fd) _isatty(fd)
+#else
+    #include <unistd.h>
+    #define CALSCRIPT_ISATTY(fd) isatty(fd)
+#endif
+
+namespace {
+    void printUsage() {
+        std::cout << "Usage: calscript [--batch [file|-]] [--jobs N] [--load image] [--serve socket [--port N]]" << std::endl;
+        std::cout << "  With no arguments, starts the interactive calculator." << std::endl;
+        std::cout << "  --batch runs a script from a file (or stdin) without prompts." << std::endl;
+        std::cout << "  --jobs evaluates independent lines of a batch script on N threads (0 = all cores)." << std::endl;
+        std::cout << "  --load starts with the functions and variables of an image written by 'save funcs'." << std::endl;
+        std::cout << "  --serve runs a session per connection on a Unix domain socket (and 127.0.0.1:N with --port)." << std::endl;
+        std::cout << "  Piped stdin is run in batch mode automatically." << std::endl;
+    }
+
+    // Loads the --load image, if any; reports failures itself
+    bool loadImage(calc::Calculator& calculator, const char* image) {
+        if (image == nullptr) return true;
+        try {
+            calculator.loadImage(image);
+            return true;
+        } catch (const calc::CalcError& e) {
+            std::cerr << "calscript: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    int runBatch(const char* path, size_t jobs, const char* image) {
+        // Batch output is only flushed when the buffer fills or the script ends
+        std::ios::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+
+        calc::Calculator calculator;
+        if (!loadImage(calculator, image)) return 2;
+        calc::ScriptRunner runner(calculator, std::cout, jobs);
+        calc::ScriptRunner::Summary summary;
+
+        if (path == nullptr || std::strcmp(path, "-") == 0) {
+            summary = runner.run(std::cin);
+        } else {
+            try {
+                calc::MappedFile file(path);
+                summary = runner.run(file.getContents());
+            } catch (const calc::CalcError& e) {
+                std::cerr << "calscript: " << e.what() << std::endl;
+                return 2;
+            }
+        }
+
+        return summary.errors == 0 ? 0 : 1;
+    }
+
+    // Set while serving, so SIGINT and SIGTERM stop the server cleanly (removing its socket)
+    calc::Server* activeServer = nullptr;
+
+    void stopServer(int) {
+        if (activeServer) activeServer->stop();
+    }
+
+    int runServer(calc::Server::Options options, const char* image) {
+        // Sessions start from the functions and variables of the image
+        calc::Calculator prototype;
+        if (!loadImage(prototype, image)) return 2;
+
+        try {
+            std::string path = options.socketPath;
+            bool tcp = options.port >= 0;
+            calc::Server server(prototype, std::move(options));
+            std::cout << "Serving on " << path;
+            if (tcp) std::cout << " and 127.0.0.1:" << server.getPort();
+            std::cout << std::endl;
+
+            activeServer = &server;
+            std::signal(SIGINT, stopServer);
+            std::signal(SIGTERM, stopServer);
+            server.run();
+            activeServer = nullptr;
+        } catch (const calc::CalcError& e) {
+            activeServer = nullptr;
+            std::cerr << "calscript: " << e.what() << std::endl;
+            return 2;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool batch = false;
+    const char* path = nullptr;
+    size_t jobs = 1;
+    const char* image = nullptr;
+    const char* socketPath = nullptr;
+    int port = -1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) {
+                path = argv[++i];
+            }
+        } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long value = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || argv[i][0] == '-') {
+                printUsage();
+                return 2;
+            }
+            jobs = value == 0 ? std::max(1u, std::thread::hardware_concurrency()) : value;
+        } else if (std::strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long value = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || argv[i][0] == '-' || value > 65535) {
+                printUsage();
+                return 2;
+            }
+            port = static_cast<int>(value);
+        } else {
+            printUsage();
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 2;
+        }
+    }
+
+    if (socketPath != nullptr) {
+        return runServer({socketPath, port}, image);
+    }
+    if (port >= 0) {
+        printUsage();
+        return 2;
+    }
+
+    if (batch || !CALSCRIPT_ISATTY(0)) {
+        return runBatch(path, jobs, image);
+    }
 
-int main() {
     calc:: Calculator calculator;
+    calculator.setOutput(std::cout);
+    if (!loadImage(calculator, image)) return 2;
 
     std::cout << "Calscript v1.0.0" << std::endl;
     std::cout << "Enter expression to solve or use commands below" << std::endl;
@@ -17,17 +167,17 @@ int main() {
     std::cout << "  del <var|vars|hist>    - Delete variable or history" << std::endl;
     std::cout << "  ls <vars|hist>    - List variables or history" << std::endl;
     std::cout << "  create func <func_name> (param1, param2, ...) : <func_body>" << std::endl;
+    std::cout << "  save funcs <file> / load funcs <file> - Save or load functions and variables" << std::endl;
     std::cout << "  use func <func_name> (use actual params)" << std::endl;
     std::cout << "  <func_name> (use actual params) - to directly use a function" << std::endl;
     std::cout << "  exit              - Exit calculator" << std::endl;
     std::cout << std::endl;
-    
+
 
     std::string input;
-    double prevResult = 0;
     while(true) {
         std::cout << calc::Constants::PROMPT;
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) break;
         if (input == "exit") break;
         else if (input == "clear")
         {
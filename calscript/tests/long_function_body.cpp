@@ -0,0 +1,26 @@
+#include "Calculator.hpp"
+#include <cstdio>
+#include <string>
+
+// Function bodies go through the optimizer, which must not recurse once per node: a long flat
+// body would overflow the stack where the same expression as a plain line works.
+namespace {
+    constexpr int TERMS = 200000;
+
+    bool check(bool condition, const char* what) {
+        std::printf("%-32s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+}
+
+int main() {
+    std::string body = "x";
+    for (int i = 1; i < TERMS; ++i) body += "+x";
+
+    calc::Calculator calculator;
+    bool ok = true;
+    ok &= check(calculator.processInput("def x 1") && calculator.evaluate(body) == TERMS, "long plain line");
+    ok &= check(calculator.processInput("create func f(x): " + body), "long body defined");
+    ok &= check(calculator.functionExists("f") && calculator.callFunction("f", {1}) == TERMS, "long body called");
+    return ok ? 0 : 1;
+}
\ No newline at end of file
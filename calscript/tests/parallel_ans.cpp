@@ -0,0 +1,43 @@
+#include "Calculator.hpp"
+#include "ScriptRunner.hpp"
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+// Parallel batch runs only split lines on their keywords; lines that read ans before anything
+// near them set it are handed back to the main calculator, so the output must still match a
+// run on one thread.
+namespace {
+    constexpr int LINES = 4000;
+
+    bool check(bool condition, const char* what) {
+        std::printf("%-32s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+
+    std::string runScript(const std::string& script, size_t jobs) {
+        calc::Calculator calculator;
+        std::ostringstream out;
+        calc::ScriptRunner runner(calculator, out, jobs);
+        runner.run(std::string_view(script));
+        return out.str();
+    }
+}
+
+int main() {
+    std::string script = "create func next(x): x + ans\n";
+    for (int i = 0; i < LINES; ++i) {
+        switch (i % 7) {
+            case 0: script += "ans * 2\n"; break;
+            case 3: script += "next(" + std::to_string(i) + ")\n"; break;
+            case 5: script += "ans / 0\n"; break;
+            default: script += std::to_string(i) + " + 1\n"; break;
+        }
+    }
+    std::string ansFirst = "ans + 1\n" + script;
+
+    bool ok = true;
+    ok &= check(runScript(script, 4) == runScript(script, 1), "mixed ans lines");
+    ok &= check(runScript(ansFirst, 4) == runScript(ansFirst, 1), "ans on the first line");
+    return ok ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "Calculator.hpp"
+#include "Server.hpp"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Server sessions must refuse every command that reads or writes a file, since any local
+// user can connect. Run against the TCP listener, as an untrusted client would.
+namespace {
+    int connectTo(int port) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0) return fd;
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    // Sends the lines then "exit", and returns everything the server answered
+    std::string converse(int port, const std::string& lines) {
+        int fd = connectTo(port);
+        if (fd < 0) return "";
+        std::string request = lines + "exit\n";
+        if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+            ::close(fd);
+            return "";
+        }
+        std::string response;
+        char buffer[4096];
+        ssize_t count;
+        while ((count = ::recv(fd, buffer, sizeof buffer, 0)) > 0) response.append(buffer, count);
+        ::close(fd);
+        return response;
+    }
+
+    // One answer per line: the header and the lines printed after it
+    std::vector<std::string> splitAnswers(const std::string& response) {
+        std::vector<std::string> answers;
+        size_t position = 0;
+        while (position < response.size()) {
+            size_t count = std::stoul(response.substr(response.find(' ', position) + 1));
+            size_t end = position;
+            for (size_t i = 0; i <= count && end != std::string::npos; ++i) {
+                end = response.find('\n', end);
+                if (end != std::string::npos) end++;
+            }
+            if (end == std::string::npos) end = response.size();
+            answers.push_back(response.substr(position, end - position));
+            position = end;
+        }
+        return answers;
+    }
+
+    bool exists(const std::string& path) {
+        return ::access(path.c_str(), F_OK) == 0;
+    }
+
+    bool check(bool condition, const char* what) {
+        std::printf("%-28s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+}
+
+int main() {
+    std::string base = "/tmp/calscript_test_" + std::to_string(::getpid());
+    std::string socketPath = base + ".sock";
+    std::string savePath = base + "_save.img";
+    std::string dumpPath = base + "_dump.json";
+    std::string imagePath = base + "_load.img";
+
+    // A readable image, so load funcs fails for the right reason
+    {
+        calc::Calculator writer;
+        writer.defineFunction("secret", {"x"}, "x + 1");
+        writer.saveImage(imagePath);
+    }
+
+    calc::Calculator prototype;
+    calc::Server server(prototype, {socketPath, 0});
+    std::thread serving([&server] { server.run(); });
+
+    std::string response = converse(server.getPort(),
+        "save funcs " + savePath + "\n"
+        "prof dump " + dumpPath + "\n"
+        "load funcs " + imagePath + "\n"
+        "secret(1)\n"
+        "1 + 1\n");
+
+    server.stop();
+    serving.join();
+
+    // Builds without profiling refuse prof dump for that reason instead
+    const std::string refused = "err 1\nError: File access is disabled in this session\n";
+    std::vector<std::string> answers = splitAnswers(response);
+    bool ok = check(answers.size() == 5, "every line answered");
+    if (ok) {
+        ok &= check(answers[0] == refused, "save funcs refused");
+        ok &= check(answers[1].rfind("err ", 0) == 0, "prof dump refused");
+        ok &= check(answers[2] == refused, "load funcs refused");
+        ok &= check(answers[3].rfind("err ", 0) == 0, "load funcs loaded nothing");
+        ok &= check(answers[4] == "ok 1\n= 2\n", "other lines still run");
+    }
+    ok &= check(!exists(savePath), "save funcs wrote nothing");
+    ok &= check(!exists(dumpPath), "prof dump wrote nothing");
+    if (!ok) std::printf("response:\n%s", response.c_str());
+
+    std::remove(savePath.c_str());
+    std::remove(dumpPath.c_str());
+    std::remove(imagePath.c_str());
+    return ok ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "Calculator.hpp"
+#include "SharedCalculator.hpp"
+#include <cstdio>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Copied calculators and published versions share their tables until one side changes them;
+// a change must never show through in a copy taken before it.
+namespace {
+    constexpr int UPDATES = 200;
+
+    bool check(bool condition, const char* what) {
+        std::printf("%-32s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+}
+
+int main() {
+    bool ok = true;
+
+    calc::Calculator original;
+    original.processInput("def rate 2");
+    original.processInput("create func grow(x): x * rate");
+    original.processInput("formula twice rate * 2");
+
+    calc::Calculator copy;
+    copy.copyStateFrom(original);
+    original.processInput("upd rate 3");
+    original.processInput("del func grow");
+    original.processInput("create func grow(x): x + rate");
+    original.processInput("def extra 1");
+    ok &= check(copy.evaluate("rate") == 2 && copy.evaluate("twice") == 4, "copy keeps variables");
+    ok &= check(copy.callFunction("grow", {10}) == 20, "copy keeps functions");
+    ok &= check(!copy.getVariables().count("extra"), "copy misses later names");
+    ok &= check(original.evaluate("twice") == 6 && original.callFunction("grow", {10}) == 13, "original changed");
+
+    copy.processInput("upd rate 5");
+    ok &= check(original.evaluate("rate") == 3 && copy.evaluate("twice") == 10, "copy changes its own");
+
+    // A call evaluates against one whole version. upd changes rate and the formula reading it
+    // in one update, so the two always agree inside a call; changed in place under a reader,
+    // they would not.
+    calc::SharedCalculator shared;
+    std::ostringstream out;
+    shared.update("def rate 0", out);
+    shared.update("formula twice rate * 2", out);
+    shared.update("create func gap(x): x + twice - 2 * rate", out);
+
+    std::vector<std::thread> readers;
+    std::vector<char> consistent(4, true);
+    for (size_t r = 0; r < consistent.size(); ++r) {
+        readers.emplace_back([&shared, &consistent, r] {
+            calc::SharedCalculator::Reader reader(shared);
+            for (int i = 0; i < UPDATES * 20; ++i) {
+                if (reader.callFunction("gap", {1}) != 1) consistent[r] = false;
+            }
+        });
+    }
+    for (int i = 1; i <= UPDATES; ++i) {
+        shared.update("upd rate " + std::to_string(i), out);
+        // Changes the function table as well
+        shared.update("create func step" + std::to_string(i) + "(x): x + " + std::to_string(i), out);
+    }
+    for (auto& reader : readers) reader.join();
+
+    bool allConsistent = true;
+    for (char c : consistent) allConsistent = allConsistent && c;
+    ok &= check(allConsistent, "readers see whole versions");
+
+    calc::SharedCalculator::Reader last(shared);
+    ok &= check(last.evaluate("rate") == UPDATES, "readers see the last update");
+    return ok ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "TokenProcessor.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Counts every heap allocation in the process, as the benchmarks do
+namespace {
+    std::atomic<size_t> allocationCount{0};
+}
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+    // Once the arena has grown to fit a line, tokenizing it again must not allocate per token
+    constexpr size_t MAX_ALLOCATIONS_PER_LINE = 1;
+    constexpr size_t WARMUP_LINES = 16;
+    constexpr size_t MEASURED_LINES = 1000;
+
+    // Same shape as the tokenize/long_200_terms benchmark
+    std::string longExpression(int terms) {
+        std::string expr;
+        for (int i = 0; i < terms; ++i) {
+            if (i > 0) expr += (i % 3 == 0) ? " + " : (i % 3 == 1) ? " * " : " - ";
+            expr += std::to_string(i % 97 + 1) + "." + std::to_string(i % 10);
+        }
+        return expr;
+    }
+
+    bool check(const char* name, const std::string& expr) {
+        calc::TokenProcessor tokenizer;
+        size_t tokens = 0;
+        auto tokenizeLine = [&] {
+            calc::TokenProcessor::Scope scope(tokenizer);
+            tokens += tokenizer.tokenize(expr).size();
+        };
+
+        for (size_t i = 0; i < WARMUP_LINES; ++i) tokenizeLine();
+        size_t before = allocationCount.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < MEASURED_LINES; ++i) tokenizeLine();
+        size_t allocations = allocationCount.load(std::memory_order_relaxed) - before;
+
+        bool ok = tokens > 0 && allocations <= MAX_ALLOCATIONS_PER_LINE * MEASURED_LINES;
+        std::printf("%-12s %zu allocations over %zu lines: %s\n", name, allocations, MEASURED_LINES,
+                    ok ? "ok" : "FAILED");
+        return ok;
+    }
+}
+
+int main() {
+    bool ok = true;
+    ok &= check("short", "2 + 3 * 4");
+    ok &= check("words", "2pi(3+4)sin(30)4e(1+2)(3+4)2phi(5)(6)sqrt2 3!(2)");
+    ok &= check("200 terms", longExpression(200));
+    return ok ? 0 : 1;
+}
\ No newline at end of file
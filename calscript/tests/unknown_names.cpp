@@ -0,0 +1,55 @@
+#include "Calculator.hpp"
+#include "Expression.hpp"
+#include "SymbolTable.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Evaluating input and compiling standalone expressions must not add names to the
+// process-wide symbol table (it never shrinks, so server clients or a service compiling
+// formulas could grow it without limit); only definitions may.
+namespace {
+    bool check(bool condition, const char* what) {
+        std::printf("%-40s %s\n", what, condition ? "ok" : "FAILED");
+        return condition;
+    }
+
+    bool known(const char* name) {
+        return calc::SymbolTable::global().lookup(name).has_value();
+    }
+
+    std::string errorOf(calc::Calculator& calculator, const char* expression) {
+        try {
+            calculator.evaluate(expression);
+        } catch (const calc::CalcError& e) {
+            return e.what();
+        }
+        return "";
+    }
+}
+
+int main() {
+    calc::Calculator calculator;
+    bool ok = true;
+
+    ok &= check(errorOf(calculator, "2 * typo_one + 1") == "Undefined variable: typo_one", "unknown name reported");
+    ok &= check(errorOf(calculator, "Typo_Two") == "Undefined variable: typo_two", "reported in lower case");
+    calculator.processInput("typo_three(4)");
+    calculator.processInput("upd typo_four 1");
+    calculator.processInput("def typo_five typo_six");
+    ok &= check(!known("typo_one") && !known("typo_two") && !known("typo_three") && !known("typo_four") &&
+                !known("typo_five") && !known("typo_six"), "evaluating interns nothing");
+
+    // Function bodies keep their names, so a variable can be defined after the function
+    ok &= check(calculator.processInput("create func f(x): x + later"), "function reading a later variable");
+    ok &= check(known("later"), "function body names interned");
+    ok &= check(calculator.processInput("def later 2") && calculator.evaluate("f(1)") == 3, "later variable read");
+    ok &= check(calculator.processInput("def defined 5") && known("defined"), "defined variable interned");
+
+    calc::Expression expression = calc::Expression::compile("Rate * 2 + base_amount - rate", {"scale"});
+    ok &= check(!known("rate") && !known("base_amount"), "expressions intern nothing");
+    ok &= check(expression.getVariables() == std::vector<std::string>{"scale", "rate", "base_amount"},
+                "expression variables in order");
+    ok &= check(expression.eval({{"scale", 0}, {"rate", 3}, {"base_amount", 1}}) == 4, "expression evaluated");
+    return ok ? 0 : 1;
+}
\ No newline at end of file